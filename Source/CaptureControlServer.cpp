@@ -0,0 +1,308 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "MappedWavWriter.cpp"
+#include "HistoryArchive.cpp"
+
+// Line-based text control for the headless standalone, listening on localhost only.
+// One client is served at a time; every command gets a single "OK ..." or "ERROR ..."
+// line back, so it can be driven from a shell with nc or similar. A client that sends
+// nothing for idleTimeoutSeconds is dropped so it can't lock everyone else out.
+//
+//   status                          sample rate, channels, history, archive and capture state
+//   freeze / unfreeze               stop or resume capture
+//   export <from> <to> <file>       write the audio between <from> and <to> seconds ago
+//   archive <minutes>               set the archive length; 0 turns it off and frees it
+//   export-archive <from> <to> <file>
+//                                   the same, from the archive, at its reduced sample rate
+//   quit                            shut the application down
+class CaptureControlServer : private juce::Thread
+{
+public:
+    static constexpr int idleTimeoutSeconds = 30;
+
+    CaptureControlServer(NewProjectAudioProcessor& p, juce::AudioDeviceManager& dm)
+        : juce::Thread("Capture Control Server"), audioProcessor(p), deviceManager(dm)
+    {
+    }
+
+    ~CaptureControlServer() override { stop(); }
+
+    bool start(int portNumber)
+    {
+        if (!listener.createListener(portNumber, "127.0.0.1"))
+            return false;
+
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        listener.close();
+        stopThread(2000);
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            std::unique_ptr<juce::StreamingSocket> client(listener.waitForNextConnection());
+
+            if (client == nullptr)
+                continue;
+
+            juce::String line;
+            while (!threadShouldExit() && readLine(*client, line))
+            {
+                const auto response = handleCommand(line.trim()) + "\n";
+                if (client->write(response.toRawUTF8(), (int)response.getNumBytesAsUTF8()) < 0)
+                    break;
+            }
+        }
+    }
+
+    bool readLine(juce::StreamingSocket& socket, juce::String& line)
+    {
+        juce::MemoryOutputStream bytes;
+        auto lastByteTime = juce::Time::getMillisecondCounter();
+
+        while (!threadShouldExit())
+        {
+            const int ready = socket.waitUntilReady(true, 200);
+            if (ready < 0)
+                return false;
+
+            if (ready == 0)
+            {
+                if (juce::Time::getMillisecondCounter() - lastByteTime > (juce::uint32)idleTimeoutSeconds * 1000)
+                    return false;
+
+                continue;
+            }
+
+            lastByteTime = juce::Time::getMillisecondCounter();
+
+            char c = 0;
+            if (socket.read(&c, 1, false) <= 0)
+                return false;
+
+            if (c == '\n')
+            {
+                line = bytes.toUTF8();
+                return true;
+            }
+
+            if (c != '\r')
+                bytes.writeByte(c);
+        }
+
+        return false;
+    }
+
+    juce::String handleCommand(const juce::String& line)
+    {
+        juce::StringArray tokens;
+        tokens.addTokens(line, " ", "\"");
+        tokens.removeEmptyStrings();
+        tokens.trim();
+
+        if (tokens.isEmpty())
+            return "ERROR empty command";
+
+        const auto command = tokens[0].toLowerCase();
+
+        if (command == "status")
+            return getStatus();
+
+        if (command == "freeze" || command == "unfreeze")
+        {
+            audioProcessor.setFrozen(command == "freeze");
+            return "OK " + command;
+        }
+
+        if (command == "export")
+        {
+            if (tokens.size() < 4)
+                return "ERROR usage: export <from seconds ago> <to seconds ago> <file>";
+
+            return exportRange(tokens[1].getDoubleValue(), tokens[2].getDoubleValue(),
+                juce::File::getCurrentWorkingDirectory().getChildFile(tokens[3].unquoted()));
+        }
+
+        if (command == "archive")
+        {
+            const auto longestMinutes = HistoryArchive::longestLengthSeconds / 60.0;
+
+            if (tokens.size() < 2 || !tokens[1].containsOnly("0123456789.") || tokens[1].isEmpty()
+                || tokens[1].getDoubleValue() > longestMinutes)
+                return "ERROR usage: archive <minutes, 0 to " + juce::String(longestMinutes) + ">";
+
+            const auto minutes = tokens[1].getDoubleValue();
+            audioProcessor.getArchive().setMaximumLength(minutes * 60.0);
+            return "OK archive=" + juce::String(minutes);
+        }
+
+        if (command == "export-archive")
+        {
+            if (tokens.size() < 4)
+                return "ERROR usage: export-archive <from seconds ago> <to seconds ago> <file>";
+
+            return exportArchiveRange(tokens[1].getDoubleValue(), tokens[2].getDoubleValue(),
+                juce::File::getCurrentWorkingDirectory().getChildFile(tokens[3].unquoted()));
+        }
+
+        if (command == "quit")
+        {
+            juce::MessageManager::callAsync([] { juce::JUCEApplicationBase::quit(); });
+            return "OK quit";
+        }
+
+        return "ERROR unknown command: " + command;
+    }
+
+    juce::String getStatus()
+    {
+        const juce::ScopedReadLock lock(audioProcessor.flashbackBufferLock);
+
+        auto* device = deviceManager.getCurrentAudioDevice();
+        const auto* buffer = audioProcessor.flashbackBuffer.get();
+        const double sampleRate = audioProcessor.getSampleRate();
+        const auto ringLength = buffer != nullptr ? (juce::int64)buffer->getNumSamples() : 0;
+        const auto captured = std::min(audioProcessor.totalSamplesCaptured.load(), ringLength);
+
+        return "OK device=\"" + (device != nullptr ? device->getName() : juce::String("none")) + "\""
+            + " sampleRate=" + juce::String(sampleRate)
+            + " channels=" + juce::String(buffer != nullptr ? buffer->getNumChannels() : 0)
+            + " history=" + juce::String(sampleRate > 0 ? ringLength / sampleRate : 0.0, 1)
+            + " captured=" + juce::String(sampleRate > 0 ? captured / sampleRate : 0.0, 1)
+            + " archived=" + juce::String(getArchivedSeconds(), 1)
+            + " frozen=" + juce::String(audioProcessor.isFrozen() ? 1 : 0)
+            + " silent=" + juce::String(audioProcessor.isCapturePausedBySilence() ? 1 : 0);
+    }
+
+    double getArchivedSeconds()
+    {
+        auto& archive = audioProcessor.getArchive();
+        const double archiveRate = archive.getSampleRate();
+        return archiveRate > 0 ? (double)archive.getNumFrames() / archiveRate : 0.0;
+    }
+
+    juce::String exportRange(double fromSecondsAgo, double toSecondsAgo, const juce::File& file)
+    {
+        juce::AudioBuffer<float> snapshot;
+        double sampleRate = 0.0;
+
+        {
+            const juce::ScopedReadLock lock(audioProcessor.flashbackBufferLock);
+
+            const auto* buffer = audioProcessor.flashbackBuffer.get();
+            sampleRate = audioProcessor.getSampleRate();
+
+            if (buffer == nullptr || sampleRate <= 0)
+                return "ERROR nothing captured";
+
+            const auto ringLength = (juce::int64)buffer->getNumSamples();
+            const auto captured = audioProcessor.totalSamplesCaptured.load();
+            const auto available = std::min(captured, ringLength);
+            const auto startBack = juce::jlimit((juce::int64)0, available, (juce::int64)(std::max(fromSecondsAgo, toSecondsAgo) * sampleRate));
+            const auto endBack = juce::jlimit((juce::int64)0, startBack, (juce::int64)(std::min(fromSecondsAgo, toSecondsAgo) * sampleRate));
+            const auto length = startBack - endBack;
+
+            if (length == 0)
+                return "ERROR empty range";
+
+            // The lock only keeps the buffer from being reallocated; the audio thread goes on
+            // writing, so the range is copied out first rather than written to disk in place
+            const auto firstPosition = captured - startBack;
+            snapshot.setSize(buffer->getNumChannels(), (int)length);
+
+            const auto start = firstPosition % ringLength;
+            const auto firstPart = std::min(length, ringLength - start);
+
+            for (int channel = 0; channel < buffer->getNumChannels(); ++channel)
+            {
+                snapshot.copyFrom(channel, 0, *buffer, channel, (int)start, (int)firstPart);
+                if (length > firstPart)
+                    snapshot.copyFrom(channel, (int)firstPart, *buffer, channel, 0, (int)(length - firstPart));
+            }
+
+            // Anything the audio thread got round to overwriting during the copy (allowing
+            // for a block it may be part way through) is dropped from the front
+            const auto oldestIntact = audioProcessor.totalSamplesCaptured.load()
+                + audioProcessor.getBlockSize() - ringLength;
+            const auto overwritten = juce::jlimit((juce::int64)0, length, oldestIntact - firstPosition);
+
+            if (overwritten == length)
+                return "ERROR range was overwritten while exporting";
+
+            if (overwritten > 0)
+            {
+                juce::AudioBuffer<float> intact(snapshot.getNumChannels(), (int)(length - overwritten));
+                for (int channel = 0; channel < snapshot.getNumChannels(); ++channel)
+                    intact.copyFrom(channel, 0, snapshot, channel, (int)overwritten, intact.getNumSamples());
+
+                snapshot = std::move(intact);
+            }
+        }
+
+        return writeFile(file, snapshot, sampleRate);
+    }
+
+    juce::String exportArchiveRange(double fromSecondsAgo, double toSecondsAgo, const juce::File& file)
+    {
+        auto& archive = audioProcessor.getArchive();
+        const double sampleRate = archive.getSampleRate();
+
+        if (sampleRate <= 0)
+            return "ERROR nothing archived";
+
+        // The archive copies out under its own lock, so there's nothing to tear here
+        const auto audio = archive.readRecent({ (juce::int64)(std::max(0.0, std::min(fromSecondsAgo, toSecondsAgo)) * sampleRate),
+                                                (juce::int64)(std::max(0.0, std::max(fromSecondsAgo, toSecondsAgo)) * sampleRate) });
+
+        if (audio.getNumSamples() == 0)
+            return "ERROR empty range";
+
+        return writeFile(file, audio, sampleRate);
+    }
+
+    juce::String writeFile(const juce::File& file, const juce::AudioBuffer<float>& audio, double sampleRate)
+    {
+        const bool success = audioProcessor.exportFormat.load() == NewProjectAudioProcessor::ExportFormat::float32
+            ? MappedWavWriter::write(file, audio, sampleRate)
+            : writePcm24(file, audio, sampleRate);
+
+        if (!success)
+            return "ERROR failed to write " + file.getFullPathName();
+
+        return "OK " + file.getFullPathName();
+    }
+
+    static bool writePcm24(const juce::File& file, const juce::AudioBuffer<float>& buffer, double sampleRate)
+    {
+        file.deleteFile();
+        std::unique_ptr<juce::FileOutputStream> fileStream(file.createOutputStream());
+
+        if (!fileStream)
+            return false;
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(
+            fileStream.release(), sampleRate, (unsigned int)buffer.getNumChannels(), 24, {}, 0));
+
+        if (!writer)
+            return false;
+
+        return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+    }
+
+    NewProjectAudioProcessor& audioProcessor;
+    juce::AudioDeviceManager& deviceManager;
+    juce::StreamingSocket listener;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CaptureControlServer)
+};
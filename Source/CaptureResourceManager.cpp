@@ -0,0 +1,290 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Anything that owns a slice of the shared history memory budget
+class HistoryClient
+{
+public:
+    virtual ~HistoryClient() = default;
+
+    virtual juce::int64 getDesiredHistorySamples() const = 0;
+    virtual juce::int64 getCurrentHistorySamples() const = 0;
+    virtual int getHistoryNumChannels() const = 0;
+    virtual double getHistorySampleRate() const = 0;
+
+    // Idle clients are the first to give memory up when the budget is tight
+    virtual bool isHistoryIdle() const = 0;
+    // Pinned clients are never shrunk below what they already hold
+    virtual bool isHistoryPinned() const = 0;
+
+    // Called on the message thread with the number of samples the client may now hold
+    virtual void setGrantedHistorySamples(juce::int64 numSamples) = 0;
+
+    // A long-term archive kept alongside the history, which is charged to the same budget
+    virtual juce::int64 getDesiredArchiveBytes() const = 0;
+    virtual juce::int64 getCurrentArchiveBytes() const = 0;
+    virtual void setGrantedArchiveBytes(juce::int64 numBytes) = 0;
+};
+
+// One of these is shared by every plugin instance in the process, via
+// juce::SharedResourcePointer. It owns the background threads that all instances'
+// analysis work is spread over, and divides a single history memory budget between
+// instances, shrinking idle ones first when there isn't enough to go round.
+class CaptureResourceManager : private juce::Timer
+{
+public:
+    static constexpr juce::int64 defaultBudgetBytes = (juce::int64)2048 * 1024 * 1024;
+    static constexpr double minimumHistorySeconds = 5.0;
+    static constexpr double maximumArchiveProportion = 0.25;
+
+    CaptureResourceManager()
+    {
+        juce::PropertiesFile::Options options;
+        options.applicationName = "Recall Sampler";
+        options.filenameSuffix = ".shared.settings";
+#if JUCE_LINUX || JUCE_BSD
+        options.folderName = "~/.config/Recall Sampler";
+#else
+        options.folderName = "Recall Sampler";
+#endif
+        options.osxLibrarySubFolder = "Application Support";
+        settings = std::make_unique<juce::PropertiesFile>(options);
+
+        budgetBytes = juce::jmax((juce::int64)64 * 1024 * 1024,
+            (juce::int64)settings->getValue("memoryBudget", juce::String(defaultBudgetBytes)).getLargeIntValue());
+
+        const int numThreads = juce::jlimit(1, 4, juce::SystemStats::getNumCpus() / 2);
+        for (int i = 0; i < numThreads; ++i)
+        {
+            auto* worker = workers.add(new juce::TimeSliceThread("Recall Sampler Worker " + juce::String(i + 1)));
+            worker->startThread();
+        }
+
+        startTimer(2000);
+    }
+
+    ~CaptureResourceManager() override
+    {
+        stopTimer();
+
+        for (auto* worker : workers)
+            worker->stopThread(2000);
+    }
+
+    //==============================================================================
+    void addWorkerClient(juce::TimeSliceClient* client)
+    {
+        const juce::ScopedLock lock(workerLock);
+
+        auto* leastBusy = workers.getFirst();
+        for (auto* worker : workers)
+            if (worker->getNumClients() < leastBusy->getNumClients())
+                leastBusy = worker;
+
+        leastBusy->addTimeSliceClient(client);
+    }
+
+    // Blocks until the client has finished any slice it's in the middle of
+    void removeWorkerClient(juce::TimeSliceClient* client)
+    {
+        const juce::ScopedLock lock(workerLock);
+
+        for (auto* worker : workers)
+            worker->removeTimeSliceClient(client);
+    }
+
+    //==============================================================================
+    void addHistoryClient(HistoryClient* client)
+    {
+        const juce::ScopedLock lock(clientLock);
+        historyClients.addIfNotAlreadyThere(client);
+    }
+
+    void removeHistoryClient(HistoryClient* client)
+    {
+        const juce::ScopedLock lock(clientLock);
+        historyClients.removeFirstMatchingValue(client);
+    }
+
+    juce::int64 getMemoryBudget() const { return budgetBytes.load(); }
+
+    void setMemoryBudget(juce::int64 newBudgetBytes)
+    {
+        budgetBytes.store(newBudgetBytes);
+        settings->setValue("memoryBudget", juce::String(newBudgetBytes));
+        settings->saveIfNeeded();
+        rebalance();
+    }
+
+    // How many samples a client that is just being prepared can have straight away,
+    // without pushing the total past the budget. The next rebalance tidies up from there.
+    // Like rebalance(), it never goes below the minimum history, however full the budget
+    // is, nor below one block, which the audio thread has to be able to write in one go.
+    juce::int64 getInitialGrant(const HistoryClient* client, juce::int64 desiredSamples, int numChannels,
+        double sampleRate, int samplesPerBlock) const
+    {
+        const juce::ScopedLock lock(clientLock);
+
+        juce::int64 usedBytes = 0;
+        for (auto* other : historyClients)
+            if (other != client)
+                usedBytes += getBytes(other->getCurrentHistorySamples(), other->getHistoryNumChannels())
+                    + other->getCurrentArchiveBytes();
+
+        const auto bytesPerSample = (juce::int64)juce::jmax(1, numChannels) * (juce::int64)sizeof(float);
+        const auto minimum = std::max((juce::int64)std::max(1, samplesPerBlock),
+            std::min(desiredSamples, (juce::int64)(minimumHistorySeconds * sampleRate)));
+
+        return std::max(minimum, std::min(desiredSamples, (budgetBytes.load() - usedBytes) / bytesPerSample));
+    }
+
+    // Hands each client its share of the budget. Archives come off the top, limited to
+    // a quarter of the budget between them and split in proportion to what they ask for.
+    // Every client's history then gets at least a few seconds (or whatever it holds
+    // already, if pinned); what is left is shared out in proportion to weight, with idle
+    // clients weighted well below active ones.
+    void rebalance()
+    {
+        struct Share
+        {
+            HistoryClient* client;
+            juce::int64 desired, granted, bytesPerSample;
+            double weight;
+        };
+
+        const juce::ScopedLock lock(clientLock);
+
+        std::vector<Share> shares;
+        auto remainingBytes = budgetBytes.load();
+
+        juce::int64 totalArchiveDesired = 0;
+        for (auto* client : historyClients)
+            totalArchiveDesired += client->getDesiredArchiveBytes();
+
+        const auto archiveBytes = std::min(totalArchiveDesired, (juce::int64)((double)remainingBytes * maximumArchiveProportion));
+
+        for (auto* client : historyClients)
+        {
+            const auto granted = totalArchiveDesired > 0
+                ? (juce::int64)((double)archiveBytes * (double)client->getDesiredArchiveBytes() / (double)totalArchiveDesired)
+                : 0;
+
+            client->setGrantedArchiveBytes(granted);
+            remainingBytes -= granted;
+        }
+
+        for (auto* client : historyClients)
+        {
+            const auto desired = client->getDesiredHistorySamples();
+            const auto current = client->getCurrentHistorySamples();
+
+            if (desired <= 0 || current <= 0)
+                continue;
+
+            const auto minimum = client->isHistoryPinned()
+                ? std::min(desired, current)
+                : std::min(desired, (juce::int64)(minimumHistorySeconds * client->getHistorySampleRate()));
+
+            const auto bytesPerSample = (juce::int64)client->getHistoryNumChannels() * (juce::int64)sizeof(float);
+            shares.push_back({ client, desired, minimum, bytesPerSample, client->isHistoryIdle() ? 0.25 : 1.0 });
+            remainingBytes -= minimum * bytesPerSample;
+        }
+
+        // Water-fill the rest; anyone who reaches what they asked for drops out and
+        // their unused share goes round again
+        for (size_t round = 0; round < shares.size() && remainingBytes > 0; ++round)
+        {
+            double totalWeight = 0.0;
+            for (const auto& share : shares)
+                if (share.granted < share.desired)
+                    totalWeight += share.weight;
+
+            if (totalWeight <= 0.0)
+                break;
+
+            const auto bytesThisRound = remainingBytes;
+            for (auto& share : shares)
+            {
+                if (share.granted >= share.desired || share.bytesPerSample == 0)
+                    continue;
+
+                const auto offeredSamples = (juce::int64)((double)bytesThisRound * share.weight / totalWeight) / share.bytesPerSample;
+                const auto extra = std::min(offeredSamples, share.desired - share.granted);
+                share.granted += extra;
+                remainingBytes -= extra * share.bytesPerSample;
+            }
+        }
+
+        // Small differences aren't worth a reallocation
+        for (const auto& share : shares)
+        {
+            const auto current = share.client->getCurrentHistorySamples();
+            const bool reachesDesired = share.granted == share.desired && current != share.desired;
+
+            if (reachesDesired || std::abs(share.granted - current) > current / 20)
+                share.client->setGrantedHistorySamples(share.granted);
+        }
+    }
+
+private:
+    void timerCallback() override { rebalance(); }
+
+    static juce::int64 getBytes(juce::int64 numSamples, int numChannels)
+    {
+        return numSamples * numChannels * (juce::int64)sizeof(float);
+    }
+
+    std::unique_ptr<juce::PropertiesFile> settings;
+    std::atomic<juce::int64> budgetBytes{ defaultBudgetBytes };
+
+    juce::CriticalSection workerLock;
+    juce::OwnedArray<juce::TimeSliceThread> workers;
+
+    juce::CriticalSection clientLock;
+    juce::Array<HistoryClient*> historyClients;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CaptureResourceManager)
+};
+
+// Background work that runs a slice at a time on the shared worker pool while started.
+// Subclasses must call stop() from their own destructor, so that no slice is still
+// running once their members start being torn down.
+class PooledWorker : private juce::TimeSliceClient
+{
+public:
+    explicit PooledWorker(int idleIntervalMs) : idleInterval(idleIntervalMs) {}
+
+    ~PooledWorker() override { jassert(!isRunning); }
+
+    void start()
+    {
+        if (!isRunning)
+            resources->addWorkerClient(this);
+
+        isRunning = true;
+    }
+
+    void stop()
+    {
+        if (isRunning)
+            resources->removeWorkerClient(this);
+
+        isRunning = false;
+    }
+
+protected:
+    // Does one slice of work. Returns true if there was more than fits in one slice,
+    // in which case the next slice comes straight away rather than after the idle interval.
+    virtual bool runSlice() = 0;
+
+    juce::SharedResourcePointer<CaptureResourceManager> resources;
+
+private:
+    int useTimeSlice() override { return runSlice() ? 0 : idleInterval; }
+
+    const int idleInterval;
+    bool isRunning = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PooledWorker)
+};
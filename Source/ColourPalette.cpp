@@ -12,6 +12,8 @@ struct ColourPalette
     juce::Colour visWaveformOutline{ juce::Colour::fromRGB(67, 118, 224) };
     juce::Colour visCursor{ juce::Colour::fromRGB(67, 118, 224) };
     juce::Colour visSelection{ juce::Colour::fromString("#FF4299e1").withAlpha(0.4f) };
+    juce::Colour visSpectrogramPeak{ juce::Colour::fromRGB(245, 93, 62) };
+    juce::Colour visMatch{ juce::Colour::fromRGB(245, 93, 62).withAlpha(0.25f) };
 
     juce::Colour controlText{ juce::Colour::fromRGB(67, 118, 224)};
 
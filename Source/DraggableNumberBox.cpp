@@ -12,6 +12,7 @@ public:
         setValue(30.0, juce::dontSendNotification);
     }
 
+    std::function<void()> onDragStart;
     std::function<void(double)> onValueChanged;
     std::function<void(double)> onDragEnd;
 
@@ -38,6 +39,16 @@ public:
 
     double getValue() const { return currentValue; }
 
+    // Smaller, dimmed text drawn after the value
+    void setNote(const juce::String& newNote)
+    {
+        if (note != newNote)
+        {
+            note = newNote;
+            repaint();
+        }
+    }
+
     void paint(juce::Graphics& g) override
     {
         // Transparent background
@@ -50,12 +61,27 @@ public:
 
         juce::String textToDraw = juce::String(currentValue, 0) + "s";
         g.drawFittedText(textToDraw, getLocalBounds(), juce::Justification::centredLeft, 1);
+
+        if (note.isNotEmpty())
+        {
+            auto noteArea = getLocalBounds();
+            noteArea.removeFromLeft(customFont.getStringWidth(textToDraw) + 6);
+
+            g.setColour(palette.controlText.withAlpha(0.5f));
+            g.setFont(juce::Font("Arial", 15.0f, juce::Font::plain));
+            g.drawFittedText(note, noteArea, juce::Justification::centredLeft, 1);
+        }
     }
 
     void mouseDown(const juce::MouseEvent& event) override
     {
         dragStartY = event.getScreenY();
         valueAtDragStart = currentValue;
+
+        if (onDragStart)
+        {
+            onDragStart();
+        }
     }
 
     void mouseDrag(const juce::MouseEvent& event) override
@@ -67,7 +93,7 @@ public:
 
     void mouseUp(const juce::MouseEvent& event) override
     {
-        if (event.mouseWasDraggedSinceMouseDown() && onDragEnd)
+        if (onDragEnd)
         {
             onDragEnd(currentValue);
         }
@@ -77,6 +103,7 @@ private:
     const ColourPalette& palette;
     double currentValue = 0.0, minValue = 0.0, maxValue = 100.0, stepValue = 0.1;
     double valueAtDragStart = 0.0;
+    juce::String note;
     int dragStartY = 0;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DraggableNumberBox)
 };
\ No newline at end of file
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include "PluginProcessor.h"
+#include "CaptureResourceManager.cpp"
+
+// Keeps a searchable index of the flashback history so a selection can be matched
+// against other places the same riff or chord movement was played.
+//
+// Audio is cut into overlapping frames as it arrives; each frame is reduced to a
+// 12-bin chroma vector, and the pattern of pitch classes above the frame's mean,
+// paired with the previous frame's, becomes a 24-bit key. Keys go into an inverted
+// index, so a query only looks at frames sharing its keys and votes on the time
+// offset between them, rather than scanning the whole history.
+class FingerprintIndex : public PooledWorker
+{
+public:
+    static constexpr int fftOrder = 12;
+    static constexpr int frameSize = 1 << fftOrder;
+    static constexpr int hopSize = frameSize / 2;
+    static constexpr int maxMatches = 8;
+    static constexpr int maxFramesPerSlice = 32;
+
+    explicit FingerprintIndex(NewProjectAudioProcessor& p)
+        : PooledWorker(50),
+        audioProcessor(p),
+        fft(fftOrder),
+        window(frameSize, juce::dsp::WindowingFunction<float>::hann, false),
+        fftData(2 * frameSize, 0.0f)
+    {
+    }
+
+    ~FingerprintIndex() override { stop(); }
+
+    // Takes a range of absolute capture positions (see totalSamplesCaptured) and returns
+    // the best matching ranges elsewhere in the history, strongest first
+    juce::Array<juce::Range<juce::int64>> findMatches(juce::Range<juce::int64> query)
+    {
+        const juce::ScopedLock lock(indexLock);
+
+        if (frames.empty())
+            return {};
+
+        const juce::Range<juce::int64> indexedRange{ frames.front().position, frames.back().position + frameSize };
+        std::map<juce::int64, int> votesByOffset;
+        int numQueryFrames = 0;
+
+        // Frames are in capture order, so the query's own frames can be found by bisection
+        auto firstQueryFrame = std::lower_bound(frames.begin(), frames.end(), query.getStart(),
+            [](const Frame& frame, juce::int64 position) { return frame.position < position; });
+
+        for (auto it = firstQueryFrame; it != frames.end() && it->position + frameSize <= query.getEnd(); ++it)
+        {
+            const auto& frame = *it;
+            ++numQueryFrames;
+            const auto bucket = buckets.find(frame.key);
+            if (bucket == buckets.end())
+                continue;
+
+            for (const auto candidate : bucket->second)
+            {
+                const auto offset = (candidate - frame.position) / hopSize;
+                if (offset != 0)
+                    ++votesByOffset[offset];
+            }
+        }
+
+        const int minimumVotes = std::max(3, numQueryFrames / 4);
+        std::vector<std::pair<int, juce::int64>> rankedOffsets;
+
+        for (const auto& [offset, votes] : votesByOffset)
+        {
+            // Neighbouring offsets are the same match landing either side of a hop
+            const auto previous = votesByOffset.find(offset - 1);
+            const auto next = votesByOffset.find(offset + 1);
+            const int neighbourVotes = std::max(previous != votesByOffset.end() ? previous->second : 0,
+                next != votesByOffset.end() ? next->second : 0);
+
+            if (votes >= minimumVotes && votes >= neighbourVotes)
+                rankedOffsets.push_back({ votes, offset });
+        }
+
+        std::sort(rankedOffsets.begin(), rankedOffsets.end(), std::greater<>());
+
+        juce::Array<juce::Range<juce::int64>> matches;
+        for (const auto& ranked : rankedOffsets)
+        {
+            const auto match = query.movedToStartAt(query.getStart() + ranked.second * hopSize);
+
+            const bool overlapsExisting = std::any_of(matches.begin(), matches.end(),
+                [&match](const auto& existing) { return existing.intersects(match); });
+
+            if (!overlapsExisting && !match.intersects(query) && indexedRange.contains(match))
+                matches.add(match);
+
+            if (matches.size() >= maxMatches)
+                break;
+        }
+
+        return matches;
+    }
+
+private:
+    struct Frame
+    {
+        juce::int64 position;
+        juce::uint32 key;
+    };
+
+    bool runSlice() override
+    {
+        const juce::ScopedReadLock bufferLock(audioProcessor.flashbackBufferLock);
+
+        auto* buffer = audioProcessor.flashbackBuffer.get();
+        if (buffer == nullptr || buffer->getNumChannels() == 0 || buffer->getNumSamples() < frameSize)
+            return false;
+
+        const auto ringLength = (juce::int64)buffer->getNumSamples();
+        const auto generation = audioProcessor.bufferGeneration.load();
+        const auto captured = audioProcessor.totalSamplesCaptured.load();
+
+        if (generation != indexedGeneration || ringLength != indexedRingLength)
+            reset(generation, ringLength);
+
+        // Skip anything already overwritten, keeping frames on the hop grid
+        const auto oldestAvailable = captured - ringLength;
+        if (nextFramePosition < oldestAvailable)
+        {
+            nextFramePosition = (oldestAvailable + hopSize - 1) / hopSize * hopSize;
+            previousBits = 0;
+        }
+
+        for (int i = 0; i < maxFramesPerSlice; ++i)
+        {
+            if (nextFramePosition + frameSize > captured)
+                return false;
+
+            const auto bits = computeChromaBits(*buffer, nextFramePosition);
+            const auto key = (previousBits << 12) | bits;
+
+            const juce::ScopedLock lock(indexLock);
+            evictFramesBefore(captured - ringLength);
+
+            // Silent frames produce no key, and break the pairing with the next frame
+            if (bits != 0 && previousBits != 0)
+            {
+                frames.push_back({ nextFramePosition, key });
+                buckets[key].push_back(nextFramePosition);
+            }
+
+            previousBits = bits;
+            nextFramePosition += hopSize;
+        }
+
+        return true;
+    }
+
+    void reset(int generation, juce::int64 ringLength)
+    {
+        indexedGeneration = generation;
+        indexedRingLength = ringLength;
+        nextFramePosition = 0;
+        previousBits = 0;
+
+        const auto sampleRate = audioProcessor.getSampleRate();
+
+        for (int bin = 0; bin < frameSize / 2; ++bin)
+        {
+            const double frequency = bin * sampleRate / frameSize;
+
+            // Only the range where pitch is well defined contributes to the chroma
+            if (frequency < 55.0 || frequency > 5000.0)
+                pitchClassForBin[bin] = -1;
+            else
+                pitchClassForBin[bin] = ((int)std::round(12.0 * std::log2(frequency / 440.0)) + 9 + 1200) % 12;
+        }
+
+        const juce::ScopedLock lock(indexLock);
+        frames.clear();
+        buckets.clear();
+    }
+
+    void evictFramesBefore(juce::int64 oldestPosition)
+    {
+        // Frames and buckets are both in capture order, so the stale ones are always at the front
+        while (!frames.empty() && frames.front().position < oldestPosition)
+        {
+            auto bucket = buckets.find(frames.front().key);
+            bucket->second.pop_front();
+
+            if (bucket->second.empty())
+                buckets.erase(bucket);
+
+            frames.pop_front();
+        }
+    }
+
+    juce::uint32 computeChromaBits(const juce::AudioBuffer<float>& buffer, juce::int64 position)
+    {
+        const int ringLength = buffer.getNumSamples();
+        const int numChannels = buffer.getNumChannels();
+        const int start = (int)(position % ringLength);
+        const int firstPart = std::min(frameSize, ringLength - start);
+        const int secondPart = frameSize - firstPart;
+
+        juce::FloatVectorOperations::clear(fftData.data(), (int)fftData.size());
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* channelData = buffer.getReadPointer(channel);
+            juce::FloatVectorOperations::add(fftData.data(), channelData + start, firstPart);
+            if (secondPart > 0)
+                juce::FloatVectorOperations::add(fftData.data() + firstPart, channelData, secondPart);
+        }
+
+        const auto range = juce::FloatVectorOperations::findMinAndMax(fftData.data(), frameSize);
+        if (std::max(std::abs(range.getStart()), std::abs(range.getEnd())) < 0.001f * numChannels)
+            return 0;
+
+        window.multiplyWithWindowingTable(fftData.data(), frameSize);
+        fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+        std::array<float, 12> chroma{};
+        for (int bin = 0; bin < frameSize / 2; ++bin)
+            if (pitchClassForBin[bin] >= 0)
+                chroma[pitchClassForBin[bin]] += fftData[bin] * fftData[bin];
+
+        const float mean = std::accumulate(chroma.begin(), chroma.end(), 0.0f) / 12.0f;
+        if (mean <= 0.0f)
+            return 0;
+
+        juce::uint32 bits = 0;
+        for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+            if (chroma[pitchClass] > mean)
+                bits |= 1u << pitchClass;
+
+        return bits;
+    }
+
+    NewProjectAudioProcessor& audioProcessor;
+
+    juce::dsp::FFT fft;
+    juce::dsp::WindowingFunction<float> window;
+    std::vector<float> fftData;
+    std::array<int, frameSize / 2> pitchClassForBin{};
+
+    // Only touched from the worker pool
+    int indexedGeneration = -1;
+    juce::int64 indexedRingLength = 0;
+    juce::int64 nextFramePosition = 0;
+    juce::uint32 previousBits = 0;
+
+    // Shared with the message thread
+    juce::CriticalSection indexLock;
+    std::deque<Frame> frames;
+    std::unordered_map<juce::uint32, std::deque<juce::int64>> buckets;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FingerprintIndex)
+};
@@ -3,29 +3,100 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "ColourPalette.cpp"
+#include "SpectrogramAnalyser.cpp"
+#include "FingerprintIndex.cpp"
+#include "HistoryArchive.cpp"
 
 class FlashbackVisualiser : public juce::Component,
     public juce::DragAndDropContainer,
     private juce::Timer
 {
 public:
-    FlashbackVisualiser(NewProjectAudioProcessor& p, const ColourPalette& pal) : audioProcessor(p), palette(pal)
+    enum class ViewMode
     {
+        waveform,
+        spectrogram,
+        archive
+    };
+
+    FlashbackVisualiser(NewProjectAudioProcessor& p, const ColourPalette& pal) : audioProcessor(p), palette(pal), spectrogram(p, pal), fingerprints(p)
+    {
+        fingerprints.start();
         startTimerHz(25);
     }
 
     ~FlashbackVisualiser() override { stopTimer(); }
 
     std::function<void()> onFullDragRequested;
-    std::function<void(juce::Range<juce::int64> selectedSampleRange)> onSelectionDragged;
+    std::function<void(const juce::AudioBuffer<float>& selectedAudio)> onSelectionDragged;
+    // In archive view, with a range of archive frames counted from the oldest one held
+    std::function<void(juce::Range<juce::int64> archiveFrameRange)> onArchiveSelectionDragged;
+    std::function<void()> onOptionsMenuRequested;
+
+    void setViewMode(ViewMode newMode)
+    {
+        // Selections are in a different timeline in archive view
+        if ((newMode == ViewMode::archive) != (viewMode == ViewMode::archive))
+        {
+            selectionArea = {};
+            matchedRanges.clear();
+        }
+
+        viewMode = newMode;
+
+        // The analyser only runs while someone is looking at it; it catches up on the
+        // whole ring when restarted
+        if (viewMode == ViewMode::spectrogram)
+            spectrogram.start();
+        else
+            spectrogram.stop();
+
+        repaint();
+    }
+
+    ViewMode getViewMode() const { return viewMode; }
+
+    bool hasSelection() const { return !selectionArea.isEmpty(); }
+
+    // Looks up other places in the history that sound like the current selection and
+    // highlights them until the selection is cleared
+    void highlightMatchesForSelection()
+    {
+        matchedRanges.clear();
+
+        const juce::ScopedReadLock lock(audioProcessor.flashbackBufferLock);
+
+        if (!hasSelection() || viewMode == ViewMode::archive || audioProcessor.flashbackBuffer->getNumSamples() == 0)
+            return;
+
+        const auto selectedRange = convertPixelAreaToSampleRange(selectionArea);
+        matchedGeneration = audioProcessor.bufferGeneration.load();
+
+        // A selection across the write head joins the newest audio onto the oldest, so
+        // each side is looked up on its own
+        for (const auto& part : ringRangeToCapturePositions(selectedRange))
+            matchedRanges.addArray(fingerprints.findMatches(part));
+
+        repaint();
+    }
 
     void mouseDown(const juce::MouseEvent& event) override
     {
+        if (event.mods.isPopupMenu())
+        {
+            if (onOptionsMenuRequested)
+                onOptionsMenuRequested();
+            return;
+        }
+
         isMakingNewSelection = !selectionArea.contains(event.getPosition());
     }
 
     void mouseDrag(const juce::MouseEvent& event) override
     {
+        if (event.mods.isPopupMenu())
+            return;
+
         if (isMakingNewSelection)
         {
             const int startX = event.getMouseDownPosition().getX();
@@ -35,11 +106,21 @@ public:
             selectionArea = juce::Rectangle<int>(left, 0, right - left, getHeight());
             repaint();
         }
+        else if (viewMode == ViewMode::archive)
+        {
+            const auto numFrames = audioProcessor.getArchive().getNumFrames();
+            const auto frameRange = selectionArea.isEmpty()
+                ? juce::Range<juce::int64>(0, numFrames)
+                : convertPixelAreaToPositionRange(selectionArea, numFrames);
+
+            if (onArchiveSelectionDragged)
+                onArchiveSelectionDragged(frameRange);
+        }
         else
         {
             if (!selectionArea.isEmpty() && onSelectionDragged)
             {
-                onSelectionDragged(convertPixelAreaToSampleRange(selectionArea));
+                onSelectionDragged(copySelectedAudio());
             }
             else if (onFullDragRequested)
             {
@@ -50,9 +131,13 @@ public:
 
     void mouseUp(const juce::MouseEvent& event) override
     {
+        if (event.mods.isPopupMenu())
+            return;
+
         if (!event.mouseWasDraggedSinceMouseDown())
         {
             selectionArea = {};
+            matchedRanges.clear();
             repaint();
         }
         isMakingNewSelection = false;
@@ -73,10 +158,101 @@ public:
         //clipPath.addRoundedRectangle(bounds.reduced(1.0f), cornerRadius);
         //g.reduceClipRegion(clipPath);
 
+        // The archive view has its own timeline, newest at the right, and no write head
+        if (viewMode == ViewMode::archive)
+        {
+            paintArchive(g);
+
+            if (!selectionArea.isEmpty())
+            {
+                g.setColour(palette.visSelection);
+                g.fillRect(selectionArea);
+            }
+            return;
+        }
+
+        // Keeps the audio thread from swapping in a resized buffer mid-paint
+        const juce::ScopedReadLock lock(audioProcessor.flashbackBufferLock);
+
         auto& buffer = *audioProcessor.flashbackBuffer;
         auto numSamples = buffer.getNumSamples();
         if (numSamples == 0) return;
 
+        const float componentWidth = (float)getWidth();
+        const float componentHeight = (float)getHeight();
+
+        if (viewMode == ViewMode::spectrogram)
+        {
+            juce::Graphics::ScopedSaveState saveState(g);
+            juce::Path clipPath;
+            clipPath.addRoundedRectangle(bounds, cornerRadius);
+            g.reduceClipRegion(clipPath);
+            spectrogram.draw(g, bounds);
+        }
+        else
+        {
+            paintWaveform(g, buffer);
+        }
+
+        paintMatches(g, numSamples);
+
+        if (!selectionArea.isEmpty())
+        {
+            g.setColour(palette.visSelection);
+            g.fillRect(selectionArea);
+        }
+
+        const auto writePosition = audioProcessor.currentBufferPostion.load();
+        const float cursorX = ((float)writePosition / (float)numSamples) * componentWidth;
+
+        if (cursorX > 0)
+        {
+            const int trailWidth = 20;
+            const float conceptualTrailStartX = cursorX - trailWidth;
+            juce::ColourGradient gradient(palette.visCursor.withAlpha(0.0f),
+                conceptualTrailStartX, 0.0f,
+                palette.visCursor.withAlpha(0.5f),
+                cursorX, 0.0f,
+                false);
+
+            const float visibleTrailStartX = std::max(0.0f, conceptualTrailStartX);
+            const float visibleTrailWidth = cursorX - visibleTrailStartX;
+
+            g.setGradientFill(gradient);
+            g.fillRect(visibleTrailStartX, 0.0f, visibleTrailWidth, componentHeight);
+        }
+
+        g.setColour(palette.visCursor);
+        g.drawVerticalLine((int)cursorX, 0.0f, (float)getHeight());
+    }
+
+private:
+    void paintArchive(juce::Graphics& g)
+    {
+        const auto peaks = audioProcessor.getArchive().getPeaks(getWidth());
+        const float componentHeight = (float)getHeight();
+
+        juce::Path waveformPath;
+        waveformPath.startNewSubPath(0, componentHeight / 2.0f);
+
+        for (int pixelX = 0; pixelX < (int)peaks.size(); ++pixelX)
+            waveformPath.lineTo((float)pixelX, juce::jmap(peaks[(size_t)pixelX].getEnd(), -1.0f, 1.0f, componentHeight, 0.0f));
+
+        for (int pixelX = (int)peaks.size() - 1; pixelX >= 0; --pixelX)
+            waveformPath.lineTo((float)pixelX, juce::jmap(peaks[(size_t)pixelX].getStart(), -1.0f, 1.0f, componentHeight, 0.0f));
+
+        waveformPath.closeSubPath();
+        g.setColour(palette.visWaveformBody);
+        g.fillPath(waveformPath);
+
+        g.setColour(palette.visWaveformOutline);
+        g.strokePath(waveformPath, juce::PathStrokeType(1.f));
+    }
+
+    void paintWaveform(juce::Graphics& g, const juce::AudioBuffer<float>& buffer)
+    {
+        const auto numSamples = buffer.getNumSamples();
+
         juce::Path waveformPath;
         const float componentWidth = (float)getWidth();
         const float componentHeight = (float)getHeight();
@@ -133,45 +309,97 @@ public:
 
         g.setColour(palette.visWaveformOutline);
         g.strokePath(waveformPath, juce::PathStrokeType(1.f));
+    }
 
-        if (!selectionArea.isEmpty())
-        {
-            g.setColour(palette.visSelection);
-            g.fillRect(selectionArea);
-        }
+    void paintMatches(juce::Graphics& g, int numSamples)
+    {
+        if (matchedRanges.isEmpty() || matchedGeneration != audioProcessor.bufferGeneration.load())
+            return;
 
-        const auto writePosition = audioProcessor.currentBufferPostion;
-        const float cursorX = ((float)writePosition / (float)numSamples) * componentWidth;
+        const auto ringLength = (juce::int64)numSamples;
+        const auto oldestPosition = audioProcessor.totalSamplesCaptured.load() - ringLength;
+        const float componentWidth = (float)getWidth();
 
-        if (cursorX > 0)
+        g.setColour(palette.visMatch);
+
+        for (const auto& match : matchedRanges)
         {
-            const int trailWidth = 20;
-            const float conceptualTrailStartX = cursorX - trailWidth;
-            juce::ColourGradient gradient(palette.visCursor.withAlpha(0.0f),
-                conceptualTrailStartX, 0.0f,
-                palette.visCursor.withAlpha(0.5f),
-                cursorX, 0.0f,
-                false);
+            // Matches that have since been overwritten are dropped
+            if (match.getStart() < oldestPosition)
+                continue;
 
-            const float visibleTrailStartX = std::max(0.0f, conceptualTrailStartX);
-            const float visibleTrailWidth = cursorX - visibleTrailStartX;
+            const auto start = match.getStart() % ringLength;
+            const auto firstPart = std::min(match.getLength(), ringLength - start);
 
-            g.setGradientFill(gradient);
-            g.fillRect(visibleTrailStartX, 0.0f, visibleTrailWidth, componentHeight);
+            auto fillSpan = [&](juce::int64 spanStart, juce::int64 spanLength)
+            {
+                const float left = componentWidth * (float)spanStart / (float)ringLength;
+                const float width = componentWidth * (float)spanLength / (float)ringLength;
+                g.fillRect(left, 0.0f, width, (float)getHeight());
+            };
+
+            fillSpan(start, firstPart);
+            if (match.getLength() > firstPart)
+                fillSpan(0, match.getLength() - firstPart);
         }
+    }
 
-        g.setColour(palette.visCursor);
-        g.drawVerticalLine((int)cursorX, 0.0f, (float)getHeight());
+    // Maps a range of ring indices onto absolute capture positions, oldest first. Indices
+    // before the write head were written on the current lap; from the write head on they
+    // hold the previous lap, the oldest audio in the ring. A range spanning the write head
+    // is therefore two separate stretches of time. Anything never captured is cut off.
+    juce::Array<juce::Range<juce::int64>> ringRangeToCapturePositions(juce::Range<juce::int64> ringRange)
+    {
+        const auto ringLength = (juce::int64)audioProcessor.flashbackBuffer->getNumSamples();
+        const auto captured = audioProcessor.totalSamplesCaptured.load();
+        const auto writePosition = captured % ringLength;
+        const auto currentLapStart = captured - writePosition;
+        const juce::Range<juce::int64> held{ std::max((juce::int64)0, captured - ringLength), captured };
+
+        juce::Array<juce::Range<juce::int64>> positions;
+
+        auto addPart = [&](juce::Range<juce::int64> indices, juce::int64 lapStart)
+        {
+            const auto part = (indices + lapStart).getIntersectionWith(held);
+            if (!part.isEmpty())
+                positions.add(part);
+        };
+
+        addPart(ringRange.getIntersectionWith({ writePosition, ringLength }), currentLapStart - ringLength);
+        addPart(ringRange.getIntersectionWith({ 0, writePosition }), currentLapStart);
+
+        return positions;
     }
 
-private:
     void timerCallback() override { repaint(); }
 
+    // The ring can be swapped for a shorter one on any block, so the selection is turned
+    // into samples and copied under the same read lock
+    juce::AudioBuffer<float> copySelectedAudio()
+    {
+        const juce::ScopedReadLock lock(audioProcessor.flashbackBufferLock);
+
+        const auto& ring = *audioProcessor.flashbackBuffer;
+        const auto range = convertPixelAreaToSampleRange(selectionArea)
+            .getIntersectionWith({ 0, (juce::int64)ring.getNumSamples() });
+
+        juce::AudioBuffer<float> selection(ring.getNumChannels(), (int)range.getLength());
+
+        for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+            selection.copyFrom(channel, 0, ring, channel, (int)range.getStart(), (int)range.getLength());
+
+        return selection;
+    }
+
     juce::Range<juce::int64> convertPixelAreaToSampleRange(juce::Rectangle<int> pixelArea)
+    {
+        return convertPixelAreaToPositionRange(pixelArea, (juce::int64)audioProcessor.flashbackBuffer->getNumSamples());
+    }
+
+    juce::Range<juce::int64> convertPixelAreaToPositionRange(juce::Rectangle<int> pixelArea, juce::int64 numSamples)
     {
         auto clippedPixelArea = pixelArea.getIntersection(getLocalBounds());
 
-        auto numSamples = (juce::int64)audioProcessor.flashbackBuffer->getNumSamples();
         auto componentWidth = (float)getWidth();
 
         auto startSample = (juce::int64)(clippedPixelArea.getX() * numSamples / componentWidth);
@@ -183,6 +411,13 @@ private:
     NewProjectAudioProcessor& audioProcessor;
     const ColourPalette& palette;
 
+    SpectrogramAnalyser spectrogram;
+    ViewMode viewMode = ViewMode::waveform;
+
+    FingerprintIndex fingerprints;
+    juce::Array<juce::Range<juce::int64>> matchedRanges;
+    int matchedGeneration = -1;
+
     juce::Rectangle<int> selectionArea;
     bool isMakingNewSelection = false;
 
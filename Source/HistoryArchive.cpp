@@ -0,0 +1,329 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include "PluginProcessor.h"
+#include "CaptureResourceManager.cpp"
+
+// The long, low-resolution tier behind the flashback ring.
+//
+// Everything the ring captures is also low-pass filtered, decimated and stored as
+// 16-bit samples in fixed-size chunks on the shared worker pool, well before the
+// ring gets round to overwriting it. An hour of archive takes about as much memory as
+// five minutes of the full-rate float ring, and it is charged to the shared history
+// budget: the resource manager grants each archive a byte allowance and the oldest
+// chunks are dropped to stay within it. Each chunk keeps min/max peaks per block so
+// the whole archive can be drawn without touching the samples.
+class HistoryArchive : public PooledWorker
+{
+public:
+    static constexpr int decimationFactor = 6;
+    static constexpr int framesPerChunk = 8192;
+    static constexpr int framesPerPeak = 256;
+    static constexpr int framesPerSlice = 8192;
+    static constexpr double defaultLengthSeconds = 60.0 * 60.0;
+    static constexpr double longestLengthSeconds = 2.0 * 60.0 * 60.0;
+
+    explicit HistoryArchive(NewProjectAudioProcessor& p) : PooledWorker(100), audioProcessor(p)
+    {
+    }
+
+    ~HistoryArchive() override { stop(); }
+
+    // Zero turns the archive off and frees it
+    void setMaximumLength(double seconds)
+    {
+        maximumLengthSeconds.store(std::max(0.0, seconds));
+
+        if (seconds <= 0.0)
+        {
+            clear();
+            return;
+        }
+
+        const juce::ScopedLock lock(archiveLock);
+        evictOldChunks();
+    }
+
+    double getMaximumLength() const { return maximumLengthSeconds.load(); }
+
+    // What the chosen length would take at the given capture format
+    juce::int64 getDesiredBytes(double sampleRate, int numChannels) const
+    {
+        return (juce::int64)(maximumLengthSeconds.load() * sampleRate / decimationFactor)
+            * numChannels * (juce::int64)sizeof(juce::int16);
+    }
+
+    juce::int64 getCurrentBytes() const
+    {
+        const juce::ScopedLock lock(archiveLock);
+        return (juce::int64)chunks.size() * framesPerChunk * archiveNumChannels * (juce::int64)sizeof(juce::int16);
+    }
+
+    // Set by the resource manager; the archive is shortened to fit
+    void setByteAllowance(juce::int64 numBytes)
+    {
+        byteAllowance.store(std::max((juce::int64)0, numBytes));
+
+        const juce::ScopedLock lock(archiveLock);
+        evictOldChunks();
+    }
+
+    double getSampleRate() const
+    {
+        const juce::ScopedLock lock(archiveLock);
+        return archiveSampleRate;
+    }
+
+    // Frames are counted from the oldest one still held
+    juce::int64 getNumFrames() const
+    {
+        const juce::ScopedLock lock(archiveLock);
+        return endFrame - firstFrame;
+    }
+
+    juce::AudioBuffer<float> read(juce::Range<juce::int64> frames) const
+    {
+        const juce::ScopedLock lock(archiveLock);
+
+        const auto clipped = frames.movedToStartAt(frames.getStart() + firstFrame)
+            .getIntersectionWith({ firstFrame, endFrame });
+
+        juce::AudioBuffer<float> result(archiveNumChannels, (int)clipped.getLength());
+
+        for (auto frame = clipped.getStart(); frame < clipped.getEnd();)
+        {
+            const auto& chunk = getChunkContaining(frame);
+            const int offset = (int)(frame - chunk.startFrame);
+            const int numFrames = (int)std::min((juce::int64)(framesPerChunk - offset), clipped.getEnd() - frame);
+            const int destination = (int)(frame - clipped.getStart());
+
+            for (int channel = 0; channel < archiveNumChannels; ++channel)
+            {
+                auto* dest = result.getWritePointer(channel, destination);
+                const auto* source = chunk.samples.data() + offset * archiveNumChannels + channel;
+
+                for (int i = 0; i < numFrames; ++i)
+                    dest[i] = source[i * archiveNumChannels] * (1.0f / 32767.0f);
+            }
+
+            frame += numFrames;
+        }
+
+        return result;
+    }
+
+    // Frames are counted back from the newest one, so the range stays put while the
+    // archive grows and evicts
+    juce::AudioBuffer<float> readRecent(juce::Range<juce::int64> framesAgo) const
+    {
+        const juce::ScopedLock lock(archiveLock);
+        const auto numFrames = endFrame - firstFrame;
+
+        return read({ numFrames - std::min(framesAgo.getEnd(), numFrames),
+                      numFrames - std::min(framesAgo.getStart(), numFrames) });
+    }
+
+    // Min/max of the whole archive split into numBuckets equal stretches, oldest first
+    std::vector<juce::Range<float>> getPeaks(int numBuckets) const
+    {
+        const juce::ScopedLock lock(archiveLock);
+
+        std::vector<juce::Range<float>> result((size_t)std::max(0, numBuckets));
+        const auto numFrames = endFrame - firstFrame;
+
+        if (numBuckets <= 0 || numFrames <= 0)
+            return result;
+
+        for (const auto& chunk : chunks)
+        {
+            for (int peak = 0; peak < framesPerChunk / framesPerPeak; ++peak)
+            {
+                const auto peakFrame = chunk.startFrame + peak * framesPerPeak;
+                if (peakFrame < firstFrame || peakFrame >= endFrame)
+                    continue;
+
+                const auto bucket = (size_t)((peakFrame - firstFrame) * numBuckets / numFrames);
+                result[bucket] = result[bucket].getUnionWith(chunk.peaks[(size_t)peak]);
+            }
+        }
+
+        return result;
+    }
+
+private:
+    struct Chunk
+    {
+        juce::int64 startFrame;
+        std::vector<juce::int16> samples;
+        std::vector<juce::Range<float>> peaks;
+    };
+
+    bool runSlice() override
+    {
+        if (maximumLengthSeconds.load() <= 0.0)
+        {
+            // Drop anything a slice already under way appended after setMaximumLength(0)
+            if (!isEmpty())
+                clear();
+
+            return false;
+        }
+
+        const juce::ScopedReadLock bufferLock(audioProcessor.flashbackBufferLock);
+
+        auto* buffer = audioProcessor.flashbackBuffer.get();
+        const double sampleRate = audioProcessor.getSampleRate();
+
+        if (buffer == nullptr || buffer->getNumChannels() == 0 || sampleRate <= 0)
+            return false;
+
+        const auto ringLength = (juce::int64)buffer->getNumSamples();
+        const auto timelineOffset = audioProcessor.timelineOffset.load();
+        const auto captured = audioProcessor.totalSamplesCaptured.load();
+
+        if (resetPending.exchange(false)
+            || sampleRate / decimationFactor != archiveSampleRate
+            || buffer->getNumChannels() != archiveNumChannels)
+            reset(sampleRate, buffer->getNumChannels(), std::max((juce::int64)0, captured - ringLength));
+
+        // Follow the ring onto its new timeline when it has been resized, so whatever
+        // hadn't been archived yet is picked up from where it was carried over to
+        archivedUpTo += timelineOffset - archivedTimelineOffset;
+        archivedTimelineOffset = timelineOffset;
+
+        archivedUpTo = std::max({ archivedUpTo, captured - ringLength, (juce::int64)0 });
+
+        const auto available = (captured - archivedUpTo) / decimationFactor * decimationFactor;
+        const int numSamples = (int)std::min(available, (juce::int64)framesPerSlice * decimationFactor);
+
+        if (numSamples <= 0)
+            return false;
+
+        decimate(*buffer, (int)(archivedUpTo % ringLength), numSamples);
+        archivedUpTo += numSamples;
+
+        return available > numSamples;
+    }
+
+    void reset(double sampleRate, int numChannels, juce::int64 startPosition)
+    {
+        const auto archiveRate = sampleRate / decimationFactor;
+
+        // Two cascaded biquads keep aliasing down to something inaudible in a preview
+        filters.clear();
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            filters.emplace_back();
+            for (auto& filter : filters.back())
+                filter.setCoefficients(juce::IIRCoefficients::makeLowPass(sampleRate, archiveRate * 0.45));
+        }
+
+        scratch.setSize(numChannels, framesPerSlice * decimationFactor);
+        archivedTimelineOffset = audioProcessor.timelineOffset.load();
+        archivedUpTo = startPosition;
+
+        const juce::ScopedLock lock(archiveLock);
+        chunks.clear();
+        archiveSampleRate = archiveRate;
+        archiveNumChannels = numChannels;
+        firstFrame = endFrame = 0;
+    }
+
+    bool isEmpty() const
+    {
+        const juce::ScopedLock lock(archiveLock);
+        return chunks.empty();
+    }
+
+    // Frees every chunk; the next slice starts again from the oldest audio in the ring
+    void clear()
+    {
+        const juce::ScopedLock lock(archiveLock);
+        std::deque<Chunk>().swap(chunks);
+        firstFrame = endFrame = 0;
+        resetPending.store(true);
+    }
+
+    void decimate(const juce::AudioBuffer<float>& ring, int start, int numSamples)
+    {
+        const int ringLength = ring.getNumSamples();
+        const int firstPart = std::min(numSamples, ringLength - start);
+
+        for (int channel = 0; channel < archiveNumChannels; ++channel)
+        {
+            scratch.copyFrom(channel, 0, ring, channel, start, firstPart);
+            if (numSamples > firstPart)
+                scratch.copyFrom(channel, firstPart, ring, channel, 0, numSamples - firstPart);
+
+            for (auto& filter : filters[(size_t)channel])
+                filter.processSamples(scratch.getWritePointer(channel), numSamples);
+        }
+
+        const juce::ScopedLock lock(archiveLock);
+
+        for (int frame = 0; frame < numSamples / decimationFactor; ++frame)
+        {
+            if (chunks.empty() || endFrame == chunks.back().startFrame + framesPerChunk)
+            {
+                chunks.push_back({ endFrame,
+                    std::vector<juce::int16>((size_t)(framesPerChunk * archiveNumChannels)),
+                    std::vector<juce::Range<float>>((size_t)(framesPerChunk / framesPerPeak)) });
+            }
+
+            auto& chunk = chunks.back();
+            const int offset = (int)(endFrame - chunk.startFrame);
+            auto& peak = chunk.peaks[(size_t)(offset / framesPerPeak)];
+
+            for (int channel = 0; channel < archiveNumChannels; ++channel)
+            {
+                const float sample = juce::jlimit(-1.0f, 1.0f, scratch.getSample(channel, frame * decimationFactor));
+                chunk.samples[(size_t)(offset * archiveNumChannels + channel)] = (juce::int16)juce::roundToInt(sample * 32767.0f);
+                peak = peak.getUnionWith(sample);
+            }
+
+            ++endFrame;
+        }
+
+        evictOldChunks();
+    }
+
+    void evictOldChunks()
+    {
+        auto maximumFrames = (juce::int64)(maximumLengthSeconds.load() * archiveSampleRate);
+
+        if (archiveNumChannels > 0)
+            maximumFrames = std::min(maximumFrames, byteAllowance.load() / (archiveNumChannels * (juce::int64)sizeof(juce::int16)));
+
+        while (!chunks.empty() && endFrame - chunks.front().startFrame > maximumFrames + framesPerChunk)
+            chunks.pop_front();
+
+        firstFrame = chunks.empty() ? endFrame : std::max(chunks.front().startFrame, endFrame - maximumFrames);
+    }
+
+    const Chunk& getChunkContaining(juce::int64 frame) const
+    {
+        return chunks[(size_t)((frame - chunks.front().startFrame) / framesPerChunk)];
+    }
+
+    NewProjectAudioProcessor& audioProcessor;
+    std::atomic<double> maximumLengthSeconds{ defaultLengthSeconds };
+    std::atomic<juce::int64> byteAllowance{ std::numeric_limits<juce::int64>::max() };
+    std::atomic<bool> resetPending{ false };
+
+    // Only touched from the worker pool
+    std::vector<std::array<juce::IIRFilter, 2>> filters;
+    juce::AudioBuffer<float> scratch;
+    juce::int64 archivedTimelineOffset = 0;
+    juce::int64 archivedUpTo = 0;
+
+    // Shared with the message thread
+    juce::CriticalSection archiveLock;
+    std::deque<Chunk> chunks;
+    double archiveSampleRate = 0.0;
+    int archiveNumChannels = 0;
+    juce::int64 firstFrame = 0;
+    juce::int64 endFrame = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HistoryArchive)
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+// Writes 32-bit float WAV files straight into a memory-mapped file.
+// The header is laid out up front for the known length, so the sample data can be
+// copied out of a snapshot of the flashback ring in one pass with no format conversion. Material
+// that doesn't fit in a 4GB RIFF is written as RF64.
+struct MappedWavWriter
+{
+    static bool write(const juce::File& file, const juce::AudioBuffer<float>& source, double sampleRate)
+    {
+        const int numChannels = source.getNumChannels();
+        const int numSamples = source.getNumSamples();
+
+        if (numChannels == 0 || numSamples == 0 || sampleRate <= 0)
+            return false;
+
+        const auto dataBytes = (juce::uint64)numSamples * (juce::uint64)numChannels * sizeof(float);
+
+        juce::MemoryOutputStream header;
+        writeHeader(header, numChannels, sampleRate, (juce::uint64)numSamples, dataBytes);
+
+        const auto totalBytes = (juce::int64)(header.getDataSize() + dataBytes);
+
+        if (!reserve(file, totalBytes))
+            return false;
+
+        juce::MemoryMappedFile mappedFile(file, { 0, totalBytes }, juce::MemoryMappedFile::readWrite);
+        auto* destination = static_cast<char*>(mappedFile.getData());
+
+        if (destination == nullptr || (juce::int64)mappedFile.getSize() < totalBytes)
+            return false;
+
+        std::memcpy(destination, header.getData(), header.getDataSize());
+        copySamples(reinterpret_cast<float*>(destination + header.getDataSize()), source);
+
+        return true;
+    }
+
+private:
+    static void copySamples(float* dest, const juce::AudioBuffer<float>& source)
+    {
+        const int numChannels = source.getNumChannels();
+        const int numSamples = source.getNumSamples();
+
+#if JUCE_LITTLE_ENDIAN
+        if (numChannels == 1)
+        {
+            std::memcpy(dest, source.getReadPointer(0), (size_t)numSamples * sizeof(float));
+            return;
+        }
+#endif
+
+        std::vector<const float*> channels;
+        for (int channel = 0; channel < numChannels; ++channel)
+            channels.push_back(source.getReadPointer(channel));
+
+        using SourceFormat = juce::AudioData::Format<juce::AudioData::Float32, juce::AudioData::NativeEndian>;
+        using DestFormat = juce::AudioData::Format<juce::AudioData::Float32, juce::AudioData::LittleEndian>;
+
+        juce::AudioData::interleaveSamples(juce::AudioData::NonInterleavedSource<SourceFormat>{ channels.data(), numChannels },
+            juce::AudioData::InterleavedDest<DestFormat>{ dest, numChannels },
+            numSamples);
+    }
+
+    static void writeHeader(juce::MemoryOutputStream& out, int numChannels, double sampleRate,
+        juce::uint64 numSamples, juce::uint64 dataBytes)
+    {
+        const int bytesPerFrame = numChannels * (int)sizeof(float);
+        const auto roundedSampleRate = (int)std::round(sampleRate);
+
+        // More than two channels needs WAVE_FORMAT_EXTENSIBLE to say which speakers they are
+        const bool useExtensible = numChannels > 2;
+
+        juce::MemoryOutputStream formatChunks;
+        formatChunks.write("fmt ", 4);
+        formatChunks.writeInt(useExtensible ? 40 : 18);
+        formatChunks.writeShort(useExtensible ? (short)0xfffe : (short)3); // WAVE_FORMAT_IEEE_FLOAT
+        formatChunks.writeShort((short)numChannels);
+        formatChunks.writeInt(roundedSampleRate);
+        formatChunks.writeInt(roundedSampleRate * bytesPerFrame);
+        formatChunks.writeShort((short)bytesPerFrame);
+        formatChunks.writeShort(32);
+
+        if (useExtensible)
+        {
+            formatChunks.writeShort(22);
+            formatChunks.writeShort(32);
+            formatChunks.writeInt(getChannelMask(numChannels));
+
+            // KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+            const juce::uint8 subFormat[] = { 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                              0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+            formatChunks.write(subFormat, sizeof(subFormat));
+        }
+        else
+        {
+            formatChunks.writeShort(0);
+        }
+
+        // WAVE id, format, fact, data header and room for the padding chunk
+        const auto largestRiffSize = 4 + (juce::uint64)formatChunks.getDataSize() + 12 + 8 + 12 + dataBytes;
+        const bool useRF64 = largestRiffSize > (juce::uint64)0xffffffff;
+
+        if (!useRF64)
+        {
+            formatChunks.write("fact", 4);
+            formatChunks.writeInt(4);
+            formatChunks.writeInt((int)numSamples);
+        }
+
+        // Pad with a JUNK chunk so the sample data starts 4-byte aligned in the mapping
+        const auto headerSize = 12 + (useRF64 ? 36 : 0) + formatChunks.getDataSize() + 8;
+        if (headerSize % 4 != 0)
+        {
+            const int paddingBytes = (int)(4 - (headerSize + 8) % 4) % 4;
+            formatChunks.write("JUNK", 4);
+            formatChunks.writeInt(paddingBytes);
+            formatChunks.writeRepeatedByte(0, (size_t)paddingBytes);
+        }
+
+        const auto riffSize = 4 + (useRF64 ? 36 : 0) + (juce::uint64)formatChunks.getDataSize() + 8 + dataBytes;
+
+        if (useRF64)
+        {
+            // Sizes live in the ds64 chunk; the 32-bit fields are all set to -1
+            out.write("RF64", 4);
+            out.writeInt(-1);
+            out.write("WAVE", 4);
+
+            out.write("ds64", 4);
+            out.writeInt(28);
+            out.writeInt64((juce::int64)riffSize);
+            out.writeInt64((juce::int64)dataBytes);
+            out.writeInt64((juce::int64)numSamples);
+            out.writeInt(0);
+        }
+        else
+        {
+            out.write("RIFF", 4);
+            out.writeInt((int)riffSize);
+            out.write("WAVE", 4);
+        }
+
+        out << formatChunks;
+
+        out.write("data", 4);
+        out.writeInt(useRF64 ? -1 : (int)dataBytes);
+    }
+
+    static int getChannelMask(int numChannels)
+    {
+        // The usual layouts up to 7.1; anything wider is left unassigned
+        switch (numChannels)
+        {
+            case 3:  return 0x7;
+            case 4:  return 0x33;
+            case 5:  return 0x37;
+            case 6:  return 0x3f;
+            case 7:  return 0x13f;
+            case 8:  return 0x63f;
+            default: return 0;
+        }
+    }
+
+    // The file's blocks have to really exist before they are written through the mapping;
+    // a sparse file that hits a full disk faults inside the memcpy and takes the host down
+    static bool reserve(const juce::File& file, juce::int64 totalBytes)
+    {
+       #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+        const int fd = open(file.getFullPathName().toRawUTF8(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+       #if JUCE_MAC
+        fstore_t store{ F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)totalBytes, 0 };
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+            {
+                close(fd);
+                return false;
+            }
+        }
+
+        const bool reserved = ftruncate(fd, (off_t)totalBytes) == 0;
+       #else
+        const bool reserved = posix_fallocate(fd, 0, (off_t)totalBytes) == 0;
+       #endif
+
+        close(fd);
+        return reserved;
+       #else
+        juce::FileOutputStream stream(file);
+
+        if (stream.failedToOpen())
+            return false;
+
+        stream.setPosition(0);
+        stream.truncate();
+
+        // Truncating at a position past the end is SetEndOfFile, which allocates the clusters
+        // (so a full disk fails here rather than in the mapping) without zero-filling them
+        // first, as writing a byte at the end would
+        if (!stream.setPosition(totalBytes))
+            return false;
+
+        return stream.truncate().wasOk();
+       #endif
+    }
+};
@@ -6,6 +6,7 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     audioProcessor(p),
     formatManager(),
     freezeButton("freezeButton", juce::DrawableButton::ButtonStyle::ImageFitted),
+    viewModeButton("viewModeButton", juce::DrawableButton::ButtonStyle::ImageFitted),
     flashbackVisualiser(p, palette),
     recordTimeBox(palette)
 {
@@ -16,42 +17,60 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     addAndMakeVisible(flashbackVisualiser);
     addAndMakeVisible(recordTimeBox);
     addAndMakeVisible(freezeButton);
+    addAndMakeVisible(viewModeButton);
 
-    flashbackVisualiser.onSelectionDragged = [this, &p](juce::Range<juce::int64> sampleRange)
+    flashbackVisualiser.onSelectionDragged = [this, &p](const juce::AudioBuffer<float>& selectedRegion)
     {
-        p.suspendProcessing(true);
-        const auto& fullRecording = p.getRecording();
+        const bool success = p.exportFormat.load() == NewProjectAudioProcessor::ExportFormat::float32
+            ? saveFloatWav(selectedRegion, p.getSampleRate())
+            : saveWav(selectedRegion, p.getSampleRate());
 
-        juce::AudioBuffer<float> selectedRegion(fullRecording.getNumChannels(), (int)sampleRange.getLength());
+        if (success)
+        {
+            //DBG("Dragging selection: " + juce::String(selectedRegion.getNumSamples()) + " samples");
+            flashbackVisualiser.performExternalDragDropOfFiles({ file.getFullPathName() }, false);
+        }
+    };
 
-        for (int i = 0; i < fullRecording.getNumChannels(); ++i)
+    flashbackVisualiser.onFullDragRequested = [this, &p]()
+    {
+        // Copied under the read lock so the file can't tear while the audio thread
+        // carries on writing into the ring
+        juce::AudioBuffer<float> rec;
         {
-            selectedRegion.copyFrom(i, 0, fullRecording, i, (int)sampleRange.getStart(), (int)sampleRange.getLength());
+            const juce::ScopedReadLock lock(p.flashbackBufferLock);
+            rec.makeCopyOf(p.getRecording());
         }
-        p.suspendProcessing(false);
 
-        const bool success = saveWav(selectedRegion);
+        const bool success = p.exportFormat.load() == NewProjectAudioProcessor::ExportFormat::float32
+            ? saveFloatWav(rec, p.getSampleRate())
+            : saveWav(rec, p.getSampleRate());
 
         if (success)
         {
-            //DBG("Dragging selection: " + juce::String(sampleRange.getLength()) + " samples");
+            DBG("Dragging full buffer: " + juce::String(rec.getNumSamples()) + " samples");
             flashbackVisualiser.performExternalDragDropOfFiles({ file.getFullPathName() }, false);
         }
     };
 
-    flashbackVisualiser.onFullDragRequested = [this, &p]()
+    // The archive is read out at its own, lower, sample rate
+    flashbackVisualiser.onArchiveSelectionDragged = [this, &p](juce::Range<juce::int64> frameRange)
     {
-        p.suspendProcessing(true);
-        const auto& rec = p.getRecording();
-        p.suspendProcessing(false);
+        auto& archive = p.getArchive();
+        const auto archived = archive.read(frameRange);
+        const double archiveRate = archive.getSampleRate();
 
-        const bool success = saveWav(rec);
+        const bool success = p.exportFormat.load() == NewProjectAudioProcessor::ExportFormat::float32
+            ? saveFloatWav(archived, archiveRate)
+            : saveWav(archived, archiveRate);
 
         if (success)
-        {
-            DBG("Dragging full buffer: " + juce::String(rec.getNumSamples()) + " samples");
             flashbackVisualiser.performExternalDragDropOfFiles({ file.getFullPathName() }, false);
-        }
+    };
+
+    flashbackVisualiser.onOptionsMenuRequested = [this]()
+    {
+        showOptionsMenu();
     };
 
     freezeButton.setLookAndFeel(customLookAndFeel.get());
@@ -74,23 +93,66 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor(NewProjectAudioPr
     freezeButton.setClickingTogglesState(true);
 
     freezeButton.setClickingTogglesState(true);
-    freezeButton.onClick = [this]() {
-        audioProcessor.setFrozen(freezeButton.getToggleState());
+    freezeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.parameters, "freeze", freezeButton);
+
+    viewModeButton.setLookAndFeel(customLookAndFeel.get());
+
+    juce::String spectrogramSVG = R"(
+        <svg fill="#000000" width="800px" height="800px" viewBox="0 0 36 36" version="1.1" preserveAspectRatio="xMidYMid meet" xmlns="http://www.w3.org/2000/svg">
+    <rect x="3" y="20" width="5" height="12" rx="1.5" ry="1.5"></rect><rect x="11" y="8" width="5" height="24" rx="1.5" ry="1.5"></rect>
+    <rect x="19" y="14" width="5" height="18" rx="1.5" ry="1.5"></rect><rect x="27" y="4" width="5" height="28" rx="1.5" ry="1.5"></rect>
+    <rect x="0" y="0" width="36" height="36" fill-opacity="0"/>
+</svg>
+    )";
+
+    std::unique_ptr<juce::Drawable> spectrogramIconOff = juce::Drawable::createFromSVG(*juce::XmlDocument::parse(spectrogramSVG));
+    std::unique_ptr<juce::Drawable> spectrogramIconOn = juce::Drawable::createFromSVG(*juce::XmlDocument::parse(spectrogramSVG));
+
+    spectrogramIconOff->replaceColour(juce::Colours::black, palette.freezeButtonOff);
+    spectrogramIconOn->replaceColour(juce::Colours::black, palette.controlText);
+
+    viewModeButton.setImages(spectrogramIconOff.get(), nullptr, nullptr, nullptr, spectrogramIconOn.get(), nullptr, nullptr, nullptr);
+    viewModeButton.setClickingTogglesState(true);
+    viewModeButton.onClick = [this]() {
+        flashbackVisualiser.setViewMode(viewModeButton.getToggleState() ? FlashbackVisualiser::ViewMode::spectrogram
+                                                                        : FlashbackVisualiser::ViewMode::waveform);
     };
 
-    recordTimeBox.setValue(audioProcessor.getRecordingDuration(), juce::dontSendNotification);
-    recordTimeBox.onValueChanged = [this, &p](double newValue)
+    // The processor resizes the history once the drag gesture ends
+    recordTimeAttachment = std::make_unique<juce::ParameterAttachment>(*audioProcessor.parameters.getParameter("duration"),
+        [this](float newValue) { recordTimeBox.setValue(newValue, juce::dontSendNotification); });
+
+    recordTimeBox.onDragStart = [this]()
     {
-        audioProcessor.setRecordingDuration(newValue);
+        recordTimeAttachment->beginGesture();
+    };
+
+    recordTimeBox.onValueChanged = [this](double newValue)
+    {
+        recordTimeAttachment->setValueAsPartOfGesture((float)newValue);
     };
 
     recordTimeBox.onDragEnd = [this](double /*finalValue*/)
     {
-        audioProcessor.applyRecordingDurationChange();
+        recordTimeAttachment->endGesture();
     };
+
+    recordTimeAttachment->sendInitialUpdate();
+
+    startTimerHz(2);
 }
 
-bool NewProjectAudioProcessorEditor::saveWav(const juce::AudioSampleBuffer& buffer)
+// The shared memory budget can leave the history shorter than the duration asked
+// for; when it does, say how much is actually being kept
+void NewProjectAudioProcessorEditor::timerCallback()
+{
+    const double heldSeconds = audioProcessor.getHeldHistorySeconds();
+    const bool isCut = heldSeconds > 0.0 && heldSeconds < audioProcessor.getRecordingDuration() - 0.5;
+
+    recordTimeBox.setNote(isCut ? "(" + juce::String(heldSeconds, 0) + "s held)" : juce::String());
+}
+
+bool NewProjectAudioProcessorEditor::saveWav(const juce::AudioSampleBuffer& buffer, double sampleRate)
 {
     if (buffer.getNumSamples() == 0 || buffer.getNumChannels() == 0)
     {
@@ -111,7 +173,7 @@ bool NewProjectAudioProcessorEditor::saveWav(const juce::AudioSampleBuffer& buff
 
     std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(
         fileStream.release(),
-        audioProcessor.getSampleRate(),
+        sampleRate,
         buffer.getNumChannels(),
         24,
         {},
@@ -134,9 +196,82 @@ bool NewProjectAudioProcessorEditor::saveWav(const juce::AudioSampleBuffer& buff
     return true;
 }
 
+bool NewProjectAudioProcessorEditor::saveFloatWav(const juce::AudioSampleBuffer& buffer, double sampleRate)
+{
+    if (buffer.getNumSamples() == 0 || buffer.getNumChannels() == 0)
+    {
+        return false;
+    }
+
+    file = juce::File::createTempFile(".wav");
+
+    return MappedWavWriter::write(file, buffer, sampleRate);
+}
+
+void NewProjectAudioProcessorEditor::showOptionsMenu()
+{
+    using ExportFormat = NewProjectAudioProcessor::ExportFormat;
+    const auto currentFormat = audioProcessor.exportFormat.load();
+
+    juce::PopupMenu menu;
+    menu.addSectionHeader("Export format");
+    menu.addItem(1, "32-bit float", true, currentFormat == ExportFormat::float32);
+    menu.addItem(2, "24-bit PCM", true, currentFormat == ExportFormat::pcm24);
+    menu.addSeparator();
+
+    using ViewMode = FlashbackVisualiser::ViewMode;
+    const bool showingArchive = flashbackVisualiser.getViewMode() == ViewMode::archive;
+    menu.addItem(3, "Find similar passages", flashbackVisualiser.hasSelection() && !showingArchive);
+    menu.addItem(4, "Show archived history", showingArchive || audioProcessor.getArchive().getMaximumLength() > 0.0, showingArchive);
+
+    // Off frees the archive entirely
+    const int archiveMinuteChoices[] = { 0, 15, 30, 60, 120 };
+    const auto currentArchiveLength = audioProcessor.getArchive().getMaximumLength();
+
+    juce::PopupMenu archiveMenu;
+    for (const auto minutes : archiveMinuteChoices)
+    {
+        archiveMenu.addItem(minutes == 0 ? juce::String("Off") : juce::String(minutes) + " minutes", true,
+            minutes * 60.0 == currentArchiveLength,
+            [this, minutes]() { audioProcessor.getArchive().setMaximumLength(minutes * 60.0); });
+    }
+
+    menu.addSubMenu("Archive length", archiveMenu);
+
+    // Shared by every Recall Sampler in the session
+    const juce::int64 megabyte = 1024 * 1024;
+    const juce::int64 budgetChoices[] = { 256 * megabyte, 512 * megabyte, 1024 * megabyte, 2048 * megabyte, 4096 * megabyte, 8192 * megabyte };
+    const auto currentBudget = resources->getMemoryBudget();
+
+    juce::PopupMenu budgetMenu;
+    for (const auto budget : budgetChoices)
+    {
+        budgetMenu.addItem(juce::String(budget / megabyte) + " MB", true, budget == currentBudget,
+            [this, budget]() { resources->setMemoryBudget(budget); });
+    }
+
+    menu.addSubMenu("Memory budget (all instances)", budgetMenu);
+
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&flashbackVisualiser).withMousePosition(),
+        [this](int result)
+        {
+            if (result == 1)
+                audioProcessor.exportFormat.store(ExportFormat::float32);
+            else if (result == 2)
+                audioProcessor.exportFormat.store(ExportFormat::pcm24);
+            else if (result == 3)
+                flashbackVisualiser.highlightMatchesForSelection();
+            else if (result == 4)
+                flashbackVisualiser.setViewMode(flashbackVisualiser.getViewMode() != ViewMode::archive ? ViewMode::archive
+                    : viewModeButton.getToggleState() ? ViewMode::spectrogram : ViewMode::waveform);
+        });
+}
+
 NewProjectAudioProcessorEditor::~NewProjectAudioProcessorEditor()
 {
+    stopTimer();
     freezeButton.setLookAndFeel(nullptr);
+    viewModeButton.setLookAndFeel(nullptr);
 }
 
 //==============================================================================
@@ -159,9 +294,11 @@ void NewProjectAudioProcessorEditor::resized()
 
     const int buttonSize = 30;
     freezeButton.setBounds(headerArea.removeFromLeft(buttonSize).withSizeKeepingCentre(buttonSize, buttonSize));
+    viewModeButton.setBounds(headerArea.removeFromRight(buttonSize).withSizeKeepingCentre(buttonSize, buttonSize));
 
     headerArea.removeFromLeft(padding / 2);
 
-    const int numberBoxWidth = 85;
+    // Wide enough for the held length when the budget cuts the history short
+    const int numberBoxWidth = 190;
     recordTimeBox.setBounds(headerArea.removeFromLeft(numberBoxWidth));
 }
\ No newline at end of file
@@ -6,8 +6,10 @@
 #include "FlashbackVisualiser.cpp"
 #include "DraggableNumberBox.cpp"
 #include "CustomLookAndFeel.h"
+#include "MappedWavWriter.cpp"
 
-class NewProjectAudioProcessorEditor : public juce::AudioProcessorEditor
+class NewProjectAudioProcessorEditor : public juce::AudioProcessorEditor,
+    private juce::Timer
 {
 public:
     NewProjectAudioProcessorEditor(NewProjectAudioProcessor&);
@@ -17,18 +19,26 @@ public:
     void resized() override;
 
 private:
-    bool saveWav(const juce::AudioSampleBuffer& buffer);
+    bool saveWav(const juce::AudioSampleBuffer& buffer, double sampleRate);
+    bool saveFloatWav(const juce::AudioSampleBuffer& buffer, double sampleRate);
+    void showOptionsMenu();
+    void timerCallback() override;
 
     NewProjectAudioProcessor& audioProcessor;
+    juce::SharedResourcePointer<CaptureResourceManager> resources;
     ColourPalette palette;
 
     juce::File file;
     juce::AudioFormatManager formatManager;
 
     juce::DrawableButton freezeButton;
+    juce::DrawableButton viewModeButton;
     DraggableNumberBox recordTimeBox;
     FlashbackVisualiser flashbackVisualiser;
 
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> freezeAttachment;
+    std::unique_ptr<juce::ParameterAttachment> recordTimeAttachment;
+
     std::unique_ptr<CustomLookAndFeel> customLookAndFeel;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NewProjectAudioProcessorEditor)
@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "HistoryArchive.cpp"
 
 NewProjectAudioProcessor::NewProjectAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -12,51 +13,293 @@ NewProjectAudioProcessor::NewProjectAudioProcessor()
         .withOutput("Output", juce::AudioChannelSet::mono(), true)
         .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
-    )
+    ),
+#else
+    :
 #endif
+    parameters(*this, nullptr, "Parameters", createParameterLayout())
 {
-    isFrozen = false;
-    recordingDurationSecs = 30.0f;
+    freezeParameter = parameters.getRawParameterValue("freeze");
+    durationParameter = parameters.getRawParameterValue("duration");
+    silenceThresholdParameter = parameters.getRawParameterValue("silenceThreshold");
+    parameters.getParameter("duration")->addListener(this);
+
+    exportFormat = ExportFormat::float32;
     isPausedBySilence = false;
     silenceDurationSeconds = 0.0f;
     currentBufferPostion = 0;
+    totalSamplesCaptured = 0;
+    bufferGeneration = 0;
+    timelineOffset = 0;
+
+    archive = std::make_unique<HistoryArchive>(*this);
+    archive->start();
 }
 
 NewProjectAudioProcessor::~NewProjectAudioProcessor()
 {
+    // The manager asks about the archive, so stop it asking before the archive goes;
+    // then stop the archive's worker before the ring it reads from goes away
+    resources->removeHistoryClient(this);
+    archive.reset();
+    parameters.getParameter("duration")->removeListener(this);
+    cancelPendingUpdate();
+    freeUnusedHistory();
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout NewProjectAudioProcessor::createParameterLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    layout.add(std::make_unique<juce::AudioParameterBool>("freeze", "Freeze", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("duration", "Duration",
+        juce::NormalisableRange<float>(1.0f, 300.0f, 1.0f), 30.0f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("silenceThreshold", "Silence Threshold",
+        juce::NormalisableRange<float>(0.5f, 60.0f, 0.5f), 3.0f));
+
+    return layout;
+}
+
+HistoryArchive& NewProjectAudioProcessor::getArchive()
+{
+    return *archive;
 }
 
 void NewProjectAudioProcessor::setFrozen(bool shouldBeFrozen)
 {
-    isFrozen.store(shouldBeFrozen);
+    auto* parameter = parameters.getParameter("freeze");
+    parameter->setValueNotifyingHost(shouldBeFrozen ? 1.0f : 0.0f);
+}
+
+bool NewProjectAudioProcessor::isFrozen() const
+{
+    return freezeParameter->load() >= 0.5f;
+}
+
+bool NewProjectAudioProcessor::isCapturePausedBySilence() const
+{
+    return isPausedBySilence.load();
 }
 
 float NewProjectAudioProcessor::getRecordingDuration() const
 {
-    return recordingDurationSecs.load();
+    return durationParameter->load();
+}
+
+double NewProjectAudioProcessor::getHeldHistorySeconds() const
+{
+    const double sampleRate = getSampleRate();
+    return sampleRate > 0 ? (double)historyLength.load() / sampleRate : 0.0;
 }
 
 void NewProjectAudioProcessor::setRecordingDuration(double newDurationInSeconds)
 {
-    recordingDurationSecs.store(static_cast<float>(newDurationInSeconds));
+    auto* parameter = parameters.getParameter("duration");
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(static_cast<float>(newDurationInSeconds)));
+}
+
+// While the duration box is being dragged the resize is held back until the
+// gesture ends. Host automation has no gesture and is applied as it arrives,
+// coalesced onto the message thread.
+void NewProjectAudioProcessor::parameterValueChanged(int /*parameterIndex*/, float /*newValue*/)
+{
+    if (!durationGestureInProgress)
+    {
+        durationChangePending = true;
+        triggerAsyncUpdate();
+    }
 }
 
+void NewProjectAudioProcessor::parameterGestureChanged(int /*parameterIndex*/, bool gestureIsStarting)
+{
+    durationGestureInProgress = gestureIsStarting;
+
+    if (!gestureIsStarting)
+    {
+        durationChangePending = true;
+        triggerAsyncUpdate();
+    }
+}
+
+void NewProjectAudioProcessor::handleAsyncUpdate()
+{
+    delete retiredHistory.exchange(nullptr);
+
+    if (durationChangePending.exchange(false))
+        applyRecordingDurationChange();
+}
+
+// The duration is only what this instance asks for; the shared memory budget
+// decides what it actually gets
 void NewProjectAudioProcessor::applyRecordingDurationChange()
 {
-    suspendProcessing(true);
+    if (flashbackBuffer == nullptr || getSampleRate() <= 0)
+        return;
 
-    const auto newDuration = recordingDurationSecs.load();
-    const int requiredSamples = static_cast<int>(newDuration * getSampleRate());
+    DBG("Requesting buffer resize. New duration: " + juce::String(getRecordingDuration()) + "s");
+    resources->rebalance();
+}
 
-    if (flashbackBuffer->getNumSamples() != requiredSamples)
+//==============================================================================
+juce::int64 NewProjectAudioProcessor::getDesiredHistorySamples() const
+{
+    return (juce::int64)(getRecordingDuration() * getSampleRate());
+}
+
+juce::int64 NewProjectAudioProcessor::getCurrentHistorySamples() const
+{
+    return historyLength.load();
+}
+
+int NewProjectAudioProcessor::getHistoryNumChannels() const
+{
+    return historyNumChannels.load();
+}
+
+double NewProjectAudioProcessor::getHistorySampleRate() const
+{
+    return getSampleRate();
+}
+
+bool NewProjectAudioProcessor::isHistoryIdle() const
+{
+    return isPausedBySilence.load();
+}
+
+bool NewProjectAudioProcessor::isHistoryPinned() const
+{
+    return isFrozen();
+}
+
+void NewProjectAudioProcessor::setGrantedHistorySamples(juce::int64 numSamples)
+{
+    resizeHistory((int)numSamples);
+}
+
+juce::int64 NewProjectAudioProcessor::getDesiredArchiveBytes() const
+{
+    return archive->getDesiredBytes(getSampleRate(), historyNumChannels.load());
+}
+
+juce::int64 NewProjectAudioProcessor::getCurrentArchiveBytes() const
+{
+    return archive->getCurrentBytes();
+}
+
+void NewProjectAudioProcessor::setGrantedArchiveBytes(juce::int64 numBytes)
+{
+    archive->setByteAllowance(numBytes);
+}
+
+namespace
+{
+    // Copies the numSamples samples that end at sourceEnd in one ring into another
+    // ring starting at destStart, wrapping in both as needed. If either ring is shorter
+    // than numSamples, only the most recent samples that fit are copied, still ending
+    // where they would have.
+    void copyRecentHistory(const juce::AudioBuffer<float>& source, int sourceEnd, int numSamples,
+        juce::AudioBuffer<float>& dest, int destStart)
     {
-        DBG("Applying buffer resize. New duration: " + juce::String(newDuration) + "s");
-        flashbackBuffer->setSize(getTotalNumInputChannels(), requiredSamples, true, true, true);
-        flashbackBuffer->clear();
-        currentBufferPostion = 0;
+        const int sourceLength = source.getNumSamples();
+        const int destLength = dest.getNumSamples();
+        const int numChannels = std::min(source.getNumChannels(), dest.getNumChannels());
+
+        if (sourceLength <= 0 || destLength <= 0)
+            return;
+
+        const int numToSkip = std::max(0, numSamples - std::min(sourceLength, destLength));
+        destStart += numToSkip;
+        numSamples -= numToSkip;
+
+        int sourcePosition = ((sourceEnd - numSamples) % sourceLength + sourceLength) % sourceLength;
+        int destPosition = destStart % destLength;
+
+        for (int remaining = numSamples; remaining > 0;)
+        {
+            const int chunk = std::min({ remaining, sourceLength - sourcePosition, destLength - destPosition });
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                dest.copyFrom(channel, destPosition, source, channel, sourcePosition, chunk);
+
+            sourcePosition = (sourcePosition + chunk) % sourceLength;
+            destPosition = (destPosition + chunk) % destLength;
+            remaining -= chunk;
+        }
     }
+}
+
+// Resizes without stopping capture. The new buffer is allocated and filled with the
+// most recent history here, on the message thread, while the audio thread carries on
+// writing into the old one; the audio thread then copies across the few blocks it
+// wrote in the meantime and swaps the buffers over.
+void NewProjectAudioProcessor::resizeHistory(int newNumSamples)
+{
+    if (flashbackBuffer == nullptr || newNumSamples <= 0 || newNumSamples == historyLength.load())
+        return;
+
+    // Only one swap in flight at a time; the next rebalance will try again
+    if (pendingHistory.load() != nullptr || retiredHistory.load() != nullptr)
+        return;
+
+    auto pending = std::make_unique<PendingHistory>();
+    pending->buffer = std::make_unique<juce::AudioBuffer<float>>(historyNumChannels.load(), newNumSamples);
+    pending->buffer->clear();
+
+    {
+        const juce::ScopedReadLock lock(flashbackBufferLock);
+
+        const auto captured = totalSamplesCaptured.load();
+        const int oldNumSamples = flashbackBuffer->getNumSamples();
+
+        pending->capturedAtCopy = captured;
+        pending->numCopied = (int)std::min({ captured, (juce::int64)oldNumSamples, (juce::int64)newNumSamples });
+
+        copyRecentHistory(*flashbackBuffer, (int)(captured % oldNumSamples), pending->numCopied, *pending->buffer, 0);
+    }
+
+    DBG("Resizing history to " + juce::String(newNumSamples / getSampleRate(), 1) + "s");
+    pendingHistory.store(pending.release());
+}
 
-    suspendProcessing(false);
+void NewProjectAudioProcessor::adoptPendingHistory()
+{
+    auto* pending = pendingHistory.load();
+
+    // The last buffer swapped out has to be freed on the message thread first
+    if (pending == nullptr || retiredHistory.load() != nullptr)
+        return;
+
+    // Never wait for readers here; if one is busy the swap happens on a later block
+    if (!flashbackBufferLock.tryEnterWrite())
+        return;
+
+    pendingHistory.store(nullptr);
+
+    auto& newBuffer = *pending->buffer;
+    const int newNumSamples = newBuffer.getNumSamples();
+    const auto capturedSinceCopy = (int)std::min({ totalSamplesCaptured.load() - pending->capturedAtCopy,
+        (juce::int64)flashbackBuffer->getNumSamples(), (juce::int64)newNumSamples });
+
+    copyRecentHistory(*flashbackBuffer, (int)currentBufferPostion.load(), capturedSinceCopy, newBuffer, pending->numCopied);
+
+    const auto newTotal = (juce::int64)pending->numCopied + capturedSinceCopy;
+    std::swap(flashbackBuffer, pending->buffer);
+    currentBufferPostion = newTotal % newNumSamples;
+    timelineOffset += newTotal - totalSamplesCaptured.load();
+    totalSamplesCaptured = newTotal;
+    historyLength = newNumSamples;
+    ++bufferGeneration;
+
+    flashbackBufferLock.exitWrite();
+
+    retiredHistory.store(pending);
+    triggerAsyncUpdate();
+}
+
+void NewProjectAudioProcessor::freeUnusedHistory()
+{
+    delete pendingHistory.exchange(nullptr);
+    delete retiredHistory.exchange(nullptr);
 }
 
 const juce::AudioBuffer<float>& NewProjectAudioProcessor::getRecording()
@@ -106,11 +349,26 @@ void NewProjectAudioProcessor::changeProgramName(int index, const juce::String&
 //==============================================================================
 void NewProjectAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    const float initialDuration = recordingDurationSecs.load();
-    currentBufferPostion = 0;
+    const float initialDuration = getRecordingDuration();
+    const int numChannels = getTotalNumInputChannels();
+    const auto initialSamples = resources->getInitialGrant(this, (juce::int64)(sampleRate * initialDuration), numChannels,
+        sampleRate, samplesPerBlock);
 
-    flashbackBuffer = std::make_unique<juce::AudioBuffer<float>>(getTotalNumInputChannels(), sampleRate * initialDuration);
-    flashbackBuffer->clear();
+    {
+        const juce::ScopedWriteLock lock(flashbackBufferLock);
+        freeUnusedHistory();
+        currentBufferPostion = 0;
+        timelineOffset -= totalSamplesCaptured.load();
+        totalSamplesCaptured = 0;
+        ++bufferGeneration;
+
+        flashbackBuffer = std::make_unique<juce::AudioBuffer<float>>(numChannels, (int)initialSamples);
+        flashbackBuffer->clear();
+        historyLength = initialSamples;
+        historyNumChannels = numChannels;
+    }
+
+    resources->addHistoryClient(this);
 
     isPausedBySilence.store(false);
     silenceDurationSeconds = 0.0f;
@@ -149,25 +407,60 @@ bool NewProjectAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts
 }
 #endif
 
+namespace
+{
+    void copySamples(float* dest, const float* source, int numSamples)
+    {
+        juce::FloatVectorOperations::copy(dest, source, numSamples);
+    }
+
+    // Straight loop so the compiler can vectorise the double -> float narrowing
+    void copySamples(float* dest, const double* source, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] = (float)source[i];
+    }
+}
+
 void NewProjectAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    captureBlock(buffer);
+}
+
+void NewProjectAudioProcessor::processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    captureBlock(buffer);
+}
+
+bool NewProjectAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+template <typename SampleType>
+void NewProjectAudioProcessor::captureBlock(const juce::AudioBuffer<SampleType>& buffer)
 {
     if (getSampleRate() <= 0)
         return;
 
-    if (isFrozen.load())
+    adoptPendingHistory();
+
+    // Host automation of freeze punches capture in and out; parameter changes are
+    // delivered per block, so the block boundary is as fine as this can get
+    if (isFrozen())
         return;
 
     juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels = getTotalNumInputChannels();
+    const int numChannels = std::min(getTotalNumInputChannels(), flashbackBuffer->getNumChannels());
 
     const float bufferDuration = (float)buffer.getNumSamples() / getSampleRate();
-    if (buffer.getMagnitude(0, buffer.getNumSamples()) < 0.0002f)
+    if (buffer.getMagnitude(0, buffer.getNumSamples()) < (SampleType)0.0002)
     {
         silenceDurationSeconds += bufferDuration;
-        if (silenceDurationSeconds >= silenceThresholdSeconds && !isPausedBySilence.load())
+        if (silenceDurationSeconds >= silenceThresholdParameter->load() && !isPausedBySilence.load())
         {
             isPausedBySilence.store(true);
-            DBG("Silence detected for 3 seconds. PAUSING recording.");
+            DBG("Silence detected for " + juce::String(silenceDurationSeconds) + " seconds. PAUSING recording.");
         }
     }
     else
@@ -178,21 +471,42 @@ void NewProjectAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, ju
 
     if (!isPausedBySilence.load())
     {
-        for (int channel = 0; channel < totalNumInputChannels; ++channel)
-        {
-            auto* channelData = buffer.getReadPointer(channel);
-            int remainingSpace = flashbackBuffer->getNumSamples() - currentBufferPostion;
-            if (buffer.getNumSamples() <= remainingSpace)
-            {
-                flashbackBuffer->copyFrom(channel, currentBufferPostion, channelData, buffer.getNumSamples());
-            }
-            else
-            {
-                flashbackBuffer->copyFrom(channel, currentBufferPostion, channelData, remainingSpace);
-                flashbackBuffer->copyFrom(channel, 0, channelData + remainingSpace, buffer.getNumSamples() - remainingSpace);
-            }
-        }
+        if (numChannels == 1)
+            writeToRing<1>(buffer, numChannels);
+        else if (numChannels == 2)
+            writeToRing<2>(buffer, numChannels);
+        else
+            writeToRing<0>(buffer, numChannels);
+
         currentBufferPostion = (currentBufferPostion + buffer.getNumSamples()) % flashbackBuffer->getNumSamples();
+        totalSamplesCaptured += buffer.getNumSamples();
+    }
+}
+
+// NumChannels of 0 means the channel count is only known at runtime
+template <int NumChannels, typename SampleType>
+void NewProjectAudioProcessor::writeToRing(const juce::AudioBuffer<SampleType>& buffer, int numChannels)
+{
+    const int channelsToWrite = NumChannels > 0 ? NumChannels : numChannels;
+    const int ringLength = flashbackBuffer->getNumSamples();
+
+    // A block longer than the whole ring only leaves its last ringLength samples behind
+    const int sourceOffset = std::max(0, buffer.getNumSamples() - ringLength);
+    const int numSamples = buffer.getNumSamples() - sourceOffset;
+    const int writePosition = (int)((currentBufferPostion.load() + sourceOffset) % ringLength);
+
+    // The wrap point is the same for every channel, so split the block once up front
+    const int firstPart = std::min(numSamples, ringLength - writePosition);
+    const int secondPart = numSamples - firstPart;
+
+    for (int channel = 0; channel < channelsToWrite; ++channel)
+    {
+        const auto* source = buffer.getReadPointer(channel, sourceOffset);
+        auto* ring = flashbackBuffer->getWritePointer(channel);
+
+        copySamples(ring + writePosition, source, firstPart);
+        if (secondPart > 0)
+            copySamples(ring, source + firstPart, secondPart);
     }
 }
 
@@ -209,15 +523,25 @@ juce::AudioProcessorEditor* NewProjectAudioProcessor::createEditor()
 //==============================================================================
 void NewProjectAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    auto state = parameters.copyState();
+    state.setProperty("exportFormat", (int)exportFormat.load(), nullptr);
+    state.setProperty("archiveLength", archive->getMaximumLength(), nullptr);
+
+    std::unique_ptr<juce::XmlElement> xml(state.createXml());
+    copyXmlToBinary(*xml, destData);
 }
 
 void NewProjectAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
+
+    if (xml == nullptr || !xml->hasTagName(parameters.state.getType()))
+        return;
+
+    auto state = juce::ValueTree::fromXml(*xml);
+    exportFormat.store((ExportFormat)(int)state.getProperty("exportFormat", (int)ExportFormat::float32));
+    archive->setMaximumLength(state.getProperty("archiveLength", HistoryArchive::defaultLengthSeconds));
+    parameters.replaceState(state);
 }
 
 //==============================================================================
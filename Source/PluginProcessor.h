@@ -1,19 +1,40 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "CaptureResourceManager.cpp"
 
-class NewProjectAudioProcessor : public juce::AudioProcessor
+class HistoryArchive;
+
+class NewProjectAudioProcessor : public juce::AudioProcessor,
+    private HistoryClient,
+    private juce::AudioProcessorParameter::Listener,
+    private juce::AsyncUpdater
 {
 public:
+    enum class ExportFormat
+    {
+        pcm24,
+        float32
+    };
+
     //==============================================================================
     NewProjectAudioProcessor();
     ~NewProjectAudioProcessor() override;
 
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
     const juce::AudioBuffer<float>& getRecording();
     void setFrozen(bool shouldBeFrozen);
+    bool isFrozen() const;
+    bool isCapturePausedBySilence() const;
     void setRecordingDuration(double newDurationInSeconds);
     void applyRecordingDurationChange();
     float getRecordingDuration() const; 
+    // What the shared memory budget has actually let the history grow to
+    double getHeldHistorySeconds() const;
+
+    // The decimated long-term tier behind the ring; see HistoryArchive
+    HistoryArchive& getArchive();
 
     //==============================================================================
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
@@ -24,6 +45,8 @@ public:
 #endif
 
     void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock(juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -48,16 +71,75 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+    juce::AudioProcessorValueTreeState parameters;
+
     std::unique_ptr<juce::AudioBuffer<float>> flashbackBuffer;
-    juce::int64 currentBufferPostion;
+    std::atomic<juce::int64> currentBufferPostion;
+
+    // Readers of flashbackBuffer off the audio thread hold this for reading; it is taken
+    // for writing whenever the buffer is reallocated, cleared or swapped for a resized one.
+    juce::ReadWriteLock flashbackBufferLock;
+    // Monotonic count of samples written into the current buffer (including any history
+    // carried over when it was resized), so workers can tell which part of the ring is
+    // new to them. bufferGeneration changes whenever this timeline starts again.
+    std::atomic<juce::int64> totalSamplesCaptured;
+    std::atomic<int> bufferGeneration;
+    // Adding this to a position on any earlier timeline gives the same audio's position
+    // on the current one. Audio from before a prepareToPlay maps to negative positions.
+    std::atomic<juce::int64> timelineOffset;
 
-    std::atomic<bool> isFrozen;
-    std::atomic<float> recordingDurationSecs;
+    std::atomic<ExportFormat> exportFormat;
 
 private:
+    // A resized copy of the history, built on the message thread and swapped in by the
+    // audio thread at the start of a block
+    struct PendingHistory
+    {
+        std::unique_ptr<juce::AudioBuffer<float>> buffer;
+        juce::int64 capturedAtCopy = 0;
+        int numCopied = 0;
+    };
+
+    juce::int64 getDesiredHistorySamples() const override;
+    juce::int64 getCurrentHistorySamples() const override;
+    int getHistoryNumChannels() const override;
+    double getHistorySampleRate() const override;
+    bool isHistoryIdle() const override;
+    bool isHistoryPinned() const override;
+    void setGrantedHistorySamples(juce::int64 numSamples) override;
+    juce::int64 getDesiredArchiveBytes() const override;
+    juce::int64 getCurrentArchiveBytes() const override;
+    void setGrantedArchiveBytes(juce::int64 numBytes) override;
+
+    void resizeHistory(int newNumSamples);
+    void adoptPendingHistory();
+    void freeUnusedHistory();
+
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int parameterIndex, bool gestureIsStarting) override;
+    void handleAsyncUpdate() override;
+
+    template <typename SampleType>
+    void captureBlock(const juce::AudioBuffer<SampleType>& buffer);
+
+    template <int NumChannels, typename SampleType>
+    void writeToRing(const juce::AudioBuffer<SampleType>& buffer, int numChannels);
+
+    std::atomic<float>* freezeParameter = nullptr;
+    std::atomic<float>* durationParameter = nullptr;
+    std::atomic<float>* silenceThresholdParameter = nullptr;
+    std::atomic<bool> durationGestureInProgress { false };
+    std::atomic<bool> durationChangePending { false };
+
+    juce::SharedResourcePointer<CaptureResourceManager> resources;
+    std::unique_ptr<HistoryArchive> archive;
+    std::atomic<PendingHistory*> pendingHistory { nullptr };
+    std::atomic<PendingHistory*> retiredHistory { nullptr };
+    std::atomic<juce::int64> historyLength { 0 };
+    std::atomic<int> historyNumChannels { 0 };
+
     std::atomic<bool> isPausedBySilence;
     float silenceDurationSeconds;
-    const float silenceThresholdSeconds = 3.0f;
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NewProjectAudioProcessor)
 };
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "CaptureResourceManager.cpp"
+#include "ColourPalette.cpp"
+
+// Turns the flashback ring into a spectrogram on the shared worker pool.
+// Only columns whose audio was written since the last pass are analysed, and the
+// result is kept in fixed-width image tiles laid out over the ring, so the cost
+// follows the amount of new audio rather than the length of the history.
+class SpectrogramAnalyser : public PooledWorker
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = 1024;
+    static constexpr int numRows = 128;
+    static constexpr int tileWidth = 256;
+    static constexpr float minDecibels = -90.0f;
+    static constexpr int maxColumnsPerSlice = 64;
+
+    SpectrogramAnalyser(NewProjectAudioProcessor& p, const ColourPalette& pal)
+        : PooledWorker(30),
+        audioProcessor(p),
+        palette(pal),
+        fft(fftOrder),
+        window(fftSize, juce::dsp::WindowingFunction<float>::hann, false),
+        fftData(2 * fftSize, 0.0f)
+    {
+        // Rows are spaced logarithmically from the last bin below Nyquist (top row) down to
+        // the first bin (bottom row), so the low end isn't squashed into a few pixels
+        const float highestBin = (float)(fftSize / 2 - 1);
+
+        for (int row = 0; row < numRows; ++row)
+        {
+            const float proportion = 1.0f - (float)row / (float)(numRows - 1);
+            binForRow[row] = juce::jlimit(1, fftSize / 2 - 1, juce::roundToInt(std::pow(highestBin, proportion)));
+        }
+    }
+
+    ~SpectrogramAnalyser() override { stop(); }
+
+    void draw(juce::Graphics& g, juce::Rectangle<float> area)
+    {
+        const juce::ScopedLock lock(tileLock);
+        if (tileRingLength <= 0)
+            return;
+
+        const int numColumns = getNumColumns(tileRingLength);
+
+        for (int tileIndex = 0; tileIndex < (int)tiles.size(); ++tileIndex)
+        {
+            const int firstColumn = tileIndex * tileWidth;
+            const int columnsInTile = std::min(tileWidth, numColumns - firstColumn);
+            const auto firstSample = (juce::int64)firstColumn * hopSize;
+            const auto endSample = std::min((juce::int64)(firstColumn + columnsInTile) * hopSize, tileRingLength);
+
+            const float left = area.getX() + area.getWidth() * (float)firstSample / (float)tileRingLength;
+            const float right = area.getX() + area.getWidth() * (float)endSample / (float)tileRingLength;
+
+            g.drawImage(tiles[tileIndex].getClippedImage({ 0, 0, columnsInTile, numRows }),
+                { left, area.getY(), right - left, area.getHeight() },
+                juce::RectanglePlacement::stretchToFit);
+        }
+    }
+
+private:
+    static int getNumColumns(juce::int64 ringLength)
+    {
+        return (int)((ringLength + hopSize - 1) / hopSize);
+    }
+
+    bool runSlice() override
+    {
+        const juce::ScopedReadLock bufferLock(audioProcessor.flashbackBufferLock);
+
+        auto* buffer = audioProcessor.flashbackBuffer.get();
+        if (buffer == nullptr || buffer->getNumChannels() == 0 || buffer->getNumSamples() < fftSize)
+            return false;
+
+        const auto ringLength = (juce::int64)buffer->getNumSamples();
+        const auto generation = audioProcessor.bufferGeneration.load();
+        const auto captured = audioProcessor.totalSamplesCaptured.load();
+
+        if (generation != analysedGeneration || ringLength != analysedRingLength)
+            reset(generation, ringLength, captured);
+
+        // Anything older than one lap has been overwritten, so never go back further than that
+        analysedUpTo = std::max(analysedUpTo, captured - ringLength);
+
+        for (int i = 0; i < maxColumnsPerSlice; ++i)
+        {
+            if (analysedUpTo >= captured)
+                return false;
+
+            const auto ringIndex = analysedUpTo % ringLength;
+            const int column = (int)(ringIndex / hopSize);
+            const auto columnEnd = std::min((juce::int64)(column + 1) * hopSize, ringLength);
+            const auto columnEndAbsolute = analysedUpTo + (columnEnd - ringIndex);
+
+            if (columnEndAbsolute > captured)
+                return false;
+
+            analyseColumn(*buffer, column, (int)columnEnd);
+            analysedUpTo = columnEndAbsolute;
+        }
+
+        return true;
+    }
+
+    void reset(int generation, juce::int64 ringLength, juce::int64 captured)
+    {
+        analysedGeneration = generation;
+        analysedRingLength = ringLength;
+        analysedUpTo = std::max((juce::int64)0, captured - ringLength);
+
+        const int numTiles = (getNumColumns(ringLength) + tileWidth - 1) / tileWidth;
+        std::vector<juce::Image> newTiles;
+        newTiles.reserve(numTiles);
+
+        for (int i = 0; i < numTiles; ++i)
+        {
+            juce::Image tile(juce::Image::ARGB, tileWidth, numRows, false, juce::SoftwareImageType());
+            tile.clear(tile.getBounds(), palette.visBackground);
+            newTiles.push_back(tile);
+        }
+
+        const juce::ScopedLock lock(tileLock);
+        tiles = std::move(newTiles);
+        tileRingLength = ringLength;
+    }
+
+    void analyseColumn(const juce::AudioBuffer<float>& buffer, int column, int windowEnd)
+    {
+        const int ringLength = buffer.getNumSamples();
+        const int numChannels = buffer.getNumChannels();
+
+        int windowStart = windowEnd - fftSize;
+        if (windowStart < 0)
+            windowStart += ringLength;
+
+        const int firstPart = std::min(fftSize, ringLength - windowStart);
+        const int secondPart = fftSize - firstPart;
+
+        juce::FloatVectorOperations::clear(fftData.data(), (int)fftData.size());
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* channelData = buffer.getReadPointer(channel);
+            juce::FloatVectorOperations::add(fftData.data(), channelData + windowStart, firstPart);
+            if (secondPart > 0)
+                juce::FloatVectorOperations::add(fftData.data() + firstPart, channelData, secondPart);
+        }
+
+        juce::FloatVectorOperations::multiply(fftData.data(), 1.0f / (float)numChannels, fftSize);
+        window.multiplyWithWindowingTable(fftData.data(), fftSize);
+        fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+        std::array<juce::Colour, numRows> columnColours;
+        const float normalisation = juce::Decibels::gainToDecibels((float)fftSize * 0.5f);
+
+        for (int row = 0; row < numRows; ++row)
+        {
+            const float decibels = juce::Decibels::gainToDecibels(fftData[binForRow[row]], minDecibels) - normalisation;
+            const float level = juce::jmap(juce::jlimit(minDecibels, 0.0f, decibels), minDecibels, 0.0f, 0.0f, 1.0f);
+
+            columnColours[row] = level < 0.5f
+                ? palette.visBackground.interpolatedWith(palette.visWaveformBody, level * 2.0f)
+                : palette.visWaveformBody.interpolatedWith(palette.visSpectrogramPeak, level * 2.0f - 1.0f);
+        }
+
+        const juce::ScopedLock lock(tileLock);
+        auto& tile = tiles[column / tileWidth];
+        const int x = column % tileWidth;
+
+        for (int row = 0; row < numRows; ++row)
+            tile.setPixelAt(x, row, columnColours[row]);
+    }
+
+    NewProjectAudioProcessor& audioProcessor;
+    const ColourPalette& palette;
+
+    juce::dsp::FFT fft;
+    juce::dsp::WindowingFunction<float> window;
+    std::vector<float> fftData;
+    std::array<int, numRows> binForRow{};
+
+    // Only touched from the worker pool
+    int analysedGeneration = -1;
+    juce::int64 analysedRingLength = 0;
+    juce::int64 analysedUpTo = 0;
+
+    // Shared with the message thread
+    juce::CriticalSection tileLock;
+    std::vector<juce::Image> tiles;
+    juce::int64 tileRingLength = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrogramAnalyser)
+};
@@ -0,0 +1,211 @@
+#include <JuceHeader.h>
+
+#if JucePlugin_Build_Standalone && JUCE_USE_CUSTOM_PLUGIN_STANDALONE_APP
+
+#include <iostream>
+#include <juce_audio_plugin_client/Standalone/juce_StandaloneFilterWindow.h>
+#include "PluginProcessor.h"
+#include "CaptureControlServer.cpp"
+
+// Same as JUCE's stock standalone app, plus a --headless mode for long unattended
+// captures: no window and no visualiser, just the audio device, the processor and a
+// local control socket.
+//
+//   --headless                run without a window
+//   --device <name>           input device to open
+//   --channels <1|2>          number of input channels to capture
+//   --history <seconds>       length of the flashback history
+//   --archive <minutes>       length of the low-resolution archive, 0 for none
+//   --export-format <float|pcm24>
+//   --port <number>           control socket port on 127.0.0.1 (default 7878)
+class RecallSamplerStandaloneApp : public juce::JUCEApplication
+{
+public:
+    RecallSamplerStandaloneApp()
+    {
+        juce::PropertiesFile::Options options;
+        options.applicationName = getApplicationName();
+        options.filenameSuffix = ".settings";
+        options.osxLibrarySubFolder = "Application Support";
+#if JUCE_LINUX || JUCE_BSD
+        options.folderName = "~/.config";
+#else
+        options.folderName = "";
+#endif
+
+        appProperties.setStorageParameters(options);
+
+        // Headless runs keep their own device setup so they don't disturb the windowed app's
+        options.filenameSuffix = ".headless.settings";
+        headlessProperties.setStorageParameters(options);
+    }
+
+    const juce::String getApplicationName() override { return JucePlugin_Name; }
+    const juce::String getApplicationVersion() override { return JucePlugin_VersionString; }
+    bool moreThanOneInstanceAllowed() override { return true; }
+    void anotherInstanceStarted(const juce::String&) override {}
+
+    void initialise(const juce::String& commandLine) override
+    {
+        const juce::ArgumentList args(getApplicationName(), juce::StringArray::fromTokens(commandLine, true));
+
+        if (args.containsOption("--headless"))
+        {
+            if (!startHeadless(args))
+            {
+                setApplicationReturnValue(1);
+                quit();
+            }
+
+            return;
+        }
+
+        mainWindow = std::make_unique<juce::StandaloneFilterWindow>(getApplicationName(),
+            juce::LookAndFeel::getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId),
+            appProperties.getUserSettings(), false);
+
+        mainWindow->setVisible(true);
+    }
+
+    void shutdown() override
+    {
+        controlServer = nullptr;
+        headlessHolder = nullptr;
+        mainWindow = nullptr;
+        appProperties.saveIfNeeded();
+        headlessProperties.saveIfNeeded();
+    }
+
+    void systemRequestedQuit() override
+    {
+        if (mainWindow != nullptr)
+            mainWindow->pluginHolder->savePluginState();
+
+        if (juce::ModalComponentManager::getInstance()->cancelAllModalComponents())
+        {
+            juce::Timer::callAfterDelay(100, []()
+            {
+                if (auto app = juce::JUCEApplicationBase::getInstance())
+                    app->systemRequestedQuit();
+            });
+        }
+        else
+        {
+            quit();
+        }
+    }
+
+private:
+    // Options take their value from the next argument ("--port 7878"), or after an
+    // equals sign ("--port=7878")
+    static juce::String getOptionValue(const juce::ArgumentList& args, juce::StringRef option)
+    {
+        const int index = args.indexOfOption(option);
+
+        if (index >= 0 && index + 1 < args.size() && !args[index + 1].isOption())
+            return args[index + 1].text.unquoted();
+
+        return args.getValueForOption(option).unquoted();
+    }
+
+    static bool fail(const juce::String& message)
+    {
+        std::cerr << message << std::endl;
+        return false;
+    }
+
+    bool startHeadless(const juce::ArgumentList& args)
+    {
+        // Everything is checked before a device is opened, so a typo doesn't start a capture
+        const auto deviceName = getOptionValue(args, "--device");
+        if (args.containsOption("--device") && deviceName.isEmpty())
+            return fail("--device needs a device name");
+
+        const auto channelsValue = getOptionValue(args, "--channels");
+        const int numChannels = channelsValue.getIntValue();
+        if (args.containsOption("--channels") && (!channelsValue.containsOnly("0123456789") || numChannels < 1 || numChannels > 2))
+            return fail("--channels must be 1 or 2");
+
+        const auto historyValue = getOptionValue(args, "--history");
+        const double historySeconds = historyValue.getDoubleValue();
+        if (args.containsOption("--history") && (!historyValue.containsOnly("0123456789.") || historySeconds < 1.0 || historySeconds > 300.0))
+            return fail("--history must be between 1 and 300 seconds");
+
+        const auto archiveValue = getOptionValue(args, "--archive");
+        const double archiveMinutes = archiveValue.getDoubleValue();
+        const double longestArchiveMinutes = HistoryArchive::longestLengthSeconds / 60.0;
+        if (args.containsOption("--archive") && (!archiveValue.containsOnly("0123456789.") || archiveValue.isEmpty()
+            || archiveMinutes > longestArchiveMinutes))
+            return fail("--archive must be between 0 and " + juce::String(longestArchiveMinutes) + " minutes");
+
+        const auto formatValue = getOptionValue(args, "--export-format");
+        if (args.containsOption("--export-format") && formatValue != "float" && formatValue != "pcm24")
+            return fail("--export-format must be float or pcm24");
+
+        const auto portValue = getOptionValue(args, "--port");
+        const int port = args.containsOption("--port") ? portValue.getIntValue() : 7878;
+        if (!portValue.containsOnly("0123456789") || port < 1 || port > 65535)
+            return fail("--port must be between 1 and 65535");
+
+        headlessHolder = std::make_unique<juce::StandalonePluginHolder>(headlessProperties.getUserSettings(), false);
+
+        // The holder mutes input by default until someone unticks it in the settings
+        // dialog, which a headless run never shows
+        headlessHolder->shouldMuteInput.setValue(false);
+
+        auto* processor = dynamic_cast<NewProjectAudioProcessor*>(headlessHolder->processor.get());
+        if (processor == nullptr)
+            return false;
+
+        auto& deviceManager = headlessHolder->deviceManager;
+        auto setup = deviceManager.getAudioDeviceSetup();
+
+        if (deviceName.isNotEmpty())
+            setup.inputDeviceName = deviceName;
+
+        if (args.containsOption("--channels"))
+        {
+            setup.useDefaultInputChannels = false;
+            setup.inputChannels.clear();
+            setup.inputChannels.setRange(0, numChannels, true);
+        }
+
+        // Nothing is monitored, so there's no output device to feed back through
+        setup.outputDeviceName = {};
+        setup.useDefaultOutputChannels = false;
+        setup.outputChannels.clear();
+
+        const auto error = deviceManager.setAudioDeviceSetup(setup, true);
+        if (error.isNotEmpty())
+            return fail("Couldn't open audio device: " + error);
+
+        if (args.containsOption("--history"))
+            processor->setRecordingDuration(historySeconds);
+
+        if (args.containsOption("--archive"))
+            processor->getArchive().setMaximumLength(archiveMinutes * 60.0);
+
+        if (args.containsOption("--export-format"))
+            processor->exportFormat.store(formatValue == "pcm24"
+                ? NewProjectAudioProcessor::ExportFormat::pcm24
+                : NewProjectAudioProcessor::ExportFormat::float32);
+
+        controlServer = std::make_unique<CaptureControlServer>(*processor, deviceManager);
+        if (!controlServer->start(port))
+            return fail("Couldn't listen on port " + juce::String(port));
+
+        std::cout << "Recall Sampler capturing headless, control port " << port << std::endl;
+        return true;
+    }
+
+    juce::ApplicationProperties appProperties;
+    juce::ApplicationProperties headlessProperties;
+    std::unique_ptr<juce::StandaloneFilterWindow> mainWindow;
+    std::unique_ptr<juce::StandalonePluginHolder> headlessHolder;
+    std::unique_ptr<CaptureControlServer> controlServer;
+};
+
+juce::JUCEApplicationBase* juce_CreateApplication();
+juce::JUCEApplicationBase* juce_CreateApplication() { return new RecallSamplerStandaloneApp(); }
+
+#endif